@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "../common/reduce.h"
+
+/*
+ * Host counterpart of reduceInteger.cu. The same 16M-element integer sum is
+ * done by recursiveReduce, which halves the array in place, and by the
+ * reduction engine in common/reduce.h on one and on all threads. Every
+ * result is reported with the effective bandwidth (bytes read per second)
+ * to set against the reduceCompleteUnrollWarps8 figures. Min, max, a custom
+ * operator and deterministic float sums on different thread counts are
+ * checked as well.
+ */
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+// Recursive Implementation of Interleaved Pair Approach
+int recursiveReduce(int *data, int const size)
+{
+    // terminate check
+    if (size == 1) return data[0];
+
+    // renew the stride
+    int const stride = size / 2;
+
+    // in-place reduction
+    for (int i = 0; i < stride; i++)
+    {
+        data[i] += data[i + stride];
+    }
+
+    // call recursively
+    return recursiveReduce(data, stride);
+}
+
+// custom operator: bitwise xor of all elements
+struct ReduceXor
+{
+    int identity() const { return 0; }
+    int operator()(const int a, const int b) const { return a ^ b; }
+};
+
+void report(const char *name, double iElaps, size_t bytes, long result)
+{
+    printf("%s elapsed %f sec %8.2f GB/s cpu_sum: %ld\n", name, iElaps,
+           bytes / 1e9 / iElaps, result);
+}
+
+int main(int argc, char **argv)
+{
+    printf("%s starting reduction ", argv[0]);
+
+    // initialization
+    int size = 1 << 24; // total number of elements to reduce
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (argc > 1) nthreads = atoi(argv[1]);
+
+    if (argc > 2) size = atoi(argv[2]);
+
+    printf("with array size %d threads %d\n", size, nthreads);
+
+    // allocate host memory
+    size_t bytes = size * sizeof(int);
+    int *h_idata = (int *) malloc(bytes);
+    int *tmp     = (int *) malloc(bytes);
+    float *h_fdata = (float *) malloc(size * sizeof(float));
+
+    // initialize the array
+    for (int i = 0; i < size; i++)
+    {
+        // mask off high 2 bytes to force max number to 255
+        h_idata[i] = (int)( rand() & 0xFF );
+        h_fdata[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+
+    memcpy (tmp, h_idata, bytes);
+
+    double iStart, iElaps;
+
+    // reference loop; recursiveReduce drops elements unless size is 2^k
+    int ref_sum = 0;
+
+    for (int i = 0; i < size; i++) ref_sum += h_idata[i];
+
+    // baseline: in place and destructive, on a copy
+    iStart = seconds();
+    int cpu_sum = recursiveReduce (tmp, size);
+    iElaps = seconds() - iStart;
+    report("cpu recursive  ", iElaps, bytes, cpu_sum);
+
+    // one thread, SIMD lanes
+    iStart = seconds();
+    cpu_sum = reduceSum(h_idata, size, 1);
+    iElaps = seconds() - iStart;
+    report("cpu lanes      ", iElaps, bytes, cpu_sum);
+
+    if (cpu_sum != ref_sum) printf("Test failed!\n");
+
+    // all threads
+    iStart = seconds();
+    cpu_sum = reduceSum(h_idata, size, nthreads);
+    iElaps = seconds() - iStart;
+    report("cpu threads    ", iElaps, bytes, cpu_sum);
+
+    if (cpu_sum != ref_sum) printf("Test failed!\n");
+
+    // min, max and a custom operator against plain loops
+    int imin = h_idata[0], imax = h_idata[0], ixor = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        if (h_idata[i] < imin) imin = h_idata[i];
+
+        if (h_idata[i] > imax) imax = h_idata[i];
+
+        ixor ^= h_idata[i];
+    }
+
+    iStart = seconds();
+    int cpu_min = reduceMin(h_idata, size, nthreads);
+    int cpu_max = reduceMax(h_idata, size, nthreads);
+    int cpu_xor = reduce(h_idata, size, ReduceXor(), nthreads);
+    iElaps = (seconds() - iStart) / 3;
+    printf("cpu min/max/xor elapsed %f sec %8.2f GB/s each: %d %d %d\n",
+           iElaps, bytes / 1e9 / iElaps, cpu_min, cpu_max, cpu_xor);
+
+    if (cpu_min != imin || cpu_max != imax || cpu_xor != ixor)
+        printf("Test failed!\n");
+
+    // float sums: fixed order gives the same bits on any thread count
+    double dsum = 0.0;
+
+    for (int i = 0; i < size; i++) dsum += h_fdata[i];
+
+    iStart = seconds();
+    float fsum = reduceSum(h_fdata, size, nthreads);
+    iElaps = seconds() - iStart;
+    printf("cpu float      elapsed %f sec %8.2f GB/s sum: %.6f (double "
+           "%.6f)\n", iElaps, size * sizeof(float) / 1e9 / iElaps, fsum,
+           dsum);
+
+    iStart = seconds();
+    float fdet = reduceSum(h_fdata, size, nthreads, true);
+    iElaps = seconds() - iStart;
+    printf("cpu float fixed elapsed %f sec %8.2f GB/s sum: %.6f\n", iElaps,
+           size * sizeof(float) / 1e9 / iElaps, fdet);
+
+    for (int t = 1; t <= 2 * nthreads + 1; t++)
+    {
+        float f = reduceSum(h_fdata, size, t, true);
+
+        if (memcmp(&f, &fdet, sizeof(float)) != 0)
+        {
+            printf("fixed order sum differs on %d threads: %.9g %.9g\n", t,
+                   f, fdet);
+        }
+    }
+
+    // free host memory
+    free(h_idata);
+    free(h_fdata);
+    free(tmp);
+
+    return EXIT_SUCCESS;
+}
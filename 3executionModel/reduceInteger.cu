@@ -1,4 +1,5 @@
 #include "../common/common.h"
+#include "../common/reduce.h"
 #include <cuda_runtime.h>
 #include <stdio.h>
 
@@ -9,25 +10,6 @@
  * are also demonstrated, such as unrolling.
  */
 
-// Recursive Implementation of Interleaved Pair Approach
-int recursiveReduce(int *data, int const size)
-{
-    // terminate check
-    if (size == 1) return data[0];
-
-    // renew the stride
-    int const stride = size / 2;
-
-    // in-place reduction
-    for (int i = 0; i < stride; i++)
-    {
-        data[i] += data[i + stride];
-    }
-
-    // call recursively
-    return recursiveReduce(data, stride);
-}
-
 // Neighbored Pair Implementation with divergence
 __global__ void reduceNeighbored (int *g_idata, int *g_odata, unsigned int n)
 {
@@ -471,7 +453,6 @@ int main(int argc, char **argv)
     size_t bytes = size * sizeof(int);
     int *h_idata = (int *) malloc(bytes);
     int *h_odata = (int *) malloc(grid.x * sizeof(int));
-    int *tmp     = (int *) malloc(bytes);
 
     // initialize the array
     for (int i = 0; i < size; i++)
@@ -480,8 +461,6 @@ int main(int argc, char **argv)
         h_idata[i] = (int)( rand() & 0xFF );
     }
 
-    memcpy (tmp, h_idata, bytes);
-
     double iStart, iElaps;
     int gpu_sum = 0;
 
@@ -493,7 +472,7 @@ int main(int argc, char **argv)
 
     // cpu reduction
     iStart = seconds();
-    int cpu_sum = recursiveReduce (tmp, size);
+    int cpu_sum = reduceSum(h_idata, size);
     iElaps = seconds() - iStart;
     printf("cpu reduce      elapsed %f sec cpu_sum: %d\n", iElaps, cpu_sum);
 
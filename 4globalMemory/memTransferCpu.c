@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "../common/hostmem.h"
+
+/*
+ * memTransfer.cu and pinMemTransfer.cu on the host, with the allocator in
+ * common/hostmem.h. A second host buffer stands in for the device array, and
+ * memcpy for cudaMemcpy both ways.
+ *
+ * Each test allocates the two buffers, fills the first, copies it there and
+ * back and frees both, NREP times, as the samples do once; the bandwidth is
+ * the 2 * nbytes copied over the time of the whole round. With malloc every
+ * round maps fresh pages and faults them in; with hostAlloc the round takes
+ * back the blocks of the last one, on huge pages, locked like cudaMallocHost
+ * memory in the pinned test. Then the copies alone are timed on buffers
+ * allocated once.
+ *
+ * Last, a snapshot loop like saveSnapshotIstep in simple2DFD allocates a
+ * staging buffer of nx * ny floats per snapshot, fills it and frees it once
+ * written.
+ */
+
+#define NREP 20
+
+// snapshot size, as in simple2DFD
+#define NX 512
+#define NY 512
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+void report(const char *name, double iElaps, size_t nbytes)
+{
+    printf("%-28s %8.3f ms %8.2f GB/s\n", name, iElaps * 1e3,
+           2.0 * nbytes / iElaps / 1e9);
+}
+
+// one round of memTransfer.cu: alloc, init, copy there and back, free
+double round_trip(size_t isize, int pool, int flags)
+{
+    size_t nbytes = isize * sizeof(float);
+    double iStart = seconds();
+
+    float *h_a = (float *)(pool ? hostAlloc(nbytes, flags) : malloc(nbytes));
+    float *d_a = (float *)(pool ? hostAlloc(nbytes, 0) : malloc(nbytes));
+
+    if (h_a == NULL || d_a == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < isize; i++) h_a[i] = 100.10f;
+
+    memcpy(d_a, h_a, nbytes);
+    memcpy(h_a, d_a, nbytes);
+
+    if (h_a[isize - 1] != 100.10f) printf("Arrays do not match.\n");
+
+    if (pool)
+    {
+        hostFree(d_a);
+        hostFree(h_a);
+    }
+    else
+    {
+        free(d_a);
+        free(h_a);
+    }
+
+    return seconds() - iStart;
+}
+
+// the fastest of NREP rounds, and the mean
+void run_rounds(const char *name, size_t isize, int pool, int flags)
+{
+    double best = 1e30, sum = 0.0;
+    char label[64];
+
+    for (int r = 0; r < NREP; r++)
+    {
+        double t = round_trip(isize, pool, flags);
+        best = t < best ? t : best;
+        sum += t;
+    }
+
+    snprintf(label, sizeof(label), "%s, best", name);
+    report(label, best, isize * sizeof(float));
+    snprintf(label, sizeof(label), "%s, mean", name);
+    report(label, sum / NREP, isize * sizeof(float));
+}
+
+// the copies alone, on buffers allocated once
+void run_copies(const char *name, float *h_a, float *d_a, size_t isize)
+{
+    size_t nbytes = isize * sizeof(float);
+    double best = 1e30;
+
+    memset(h_a, 0, nbytes);
+    memset(d_a, 0, nbytes);
+
+    for (int r = 0; r < NREP; r++)
+    {
+        double iStart = seconds();
+        memcpy(d_a, h_a, nbytes);
+        memcpy(h_a, d_a, nbytes);
+        double t = seconds() - iStart;
+        best = t < best ? t : best;
+    }
+
+    report(name, best, nbytes);
+}
+
+// a staging buffer per snapshot, filled and freed once written
+void run_snapshots(const char *name, int pool)
+{
+    size_t nbytes = (size_t)NX * NY * sizeof(float);
+    int nsnap = 10 * NREP;
+    double sum = 0.0;
+
+    double iStart = seconds();
+
+    for (int s = 0; s < nsnap; s++)
+    {
+        float *iwave = (float *)(pool ? hostMalloc(nbytes) : malloc(nbytes));
+
+        if (iwave == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < NX * NY; i++) iwave[i] = (float)s;
+
+        sum += iwave[s];
+
+        if (pool)
+            hostFree(iwave);
+        else
+            free(iwave);
+    }
+
+    double iElaps = seconds() - iStart;
+
+    printf("%-28s %8.3f ms per snapshot (%.0f)\n", name, iElaps * 1e3 / nsnap,
+           sum);
+}
+
+int main(int argc, char **argv)
+{
+    // memory size
+    size_t isize = 1 << 22;
+
+    if (argc > 1) isize = (size_t)atol(argv[1]);
+
+    size_t nbytes = isize * sizeof(float);
+
+    printf("%s starting with memory size %zu nbyte %5.2fMB\n", argv[0], isize,
+           nbytes / (1024.0f * 1024.0f));
+
+    run_rounds("malloc", isize, 0, 0);
+    run_rounds("hostAlloc", isize, 1, 0);
+    run_rounds("hostAlloc, locked", isize, 1, HOST_LOCKED);
+
+    float *h_a = (float *)malloc(nbytes);
+    float *d_a = (float *)malloc(nbytes);
+
+    if (h_a == NULL || d_a == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    run_copies("copies, malloc", h_a, d_a, isize);
+    free(h_a);
+    free(d_a);
+
+    h_a = (float *)hostAlloc(nbytes, HOST_LOCKED | HOST_TOUCH);
+    d_a = (float *)hostAlloc(nbytes, HOST_TOUCH);
+
+    if (h_a == NULL || d_a == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    run_copies("copies, hostAlloc", h_a, d_a, isize);
+    hostFree(h_a);
+    hostFree(d_a);
+
+    run_snapshots("snapshots, malloc", 0);
+    run_snapshots("snapshots, hostMalloc", 1);
+
+    hostPrintStats("hostmem");
+    hostTrim();
+
+    return EXIT_SUCCESS;
+}
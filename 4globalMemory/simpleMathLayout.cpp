@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "../common/layout.h"
+
+/*
+ * Host benchmark of the layouts in common/layout.h. The computation of
+ * simpleMathAoS.cu / simpleMathSoA.cu (x + 10, y + 20) is written once as a
+ * template over the layout and run on AoS, SoA and AoSoA storage of the
+ * same innerStruct, for a range of array sizes: once indexing record by
+ * record as testInnerStructHost does, once run by run (see layout.h), which
+ * AoSoA needs to vectorize. A second kernel uses only one field of a wider
+ * record, the case where AoS drags unused bytes through the cache.
+ * Bandwidth counts the bytes of the fields each kernel reads and writes;
+ * every result is checked against a plain loop.
+ *
+ * Built with -O3: gcc's -O2 vectorizes only loops that need no checks,
+ * which hides the difference the layouts make.
+ */
+
+struct innerStruct
+{
+    float x;
+    float y;
+};
+
+LAYOUT_RECORD(innerStruct, LAYOUT_FIELD(innerStruct, x),
+              LAYOUT_FIELD(innerStruct, y))
+
+// a record of which the second kernel only touches the energy
+struct particle
+{
+    float x, y, z;
+    float vx, vy, vz;
+    float mass;
+    float energy;
+};
+
+LAYOUT_RECORD(particle, LAYOUT_FIELD(particle, x), LAYOUT_FIELD(particle, y),
+              LAYOUT_FIELD(particle, z), LAYOUT_FIELD(particle, vx),
+              LAYOUT_FIELD(particle, vy), LAYOUT_FIELD(particle, vz),
+              LAYOUT_FIELD(particle, mass), LAYOUT_FIELD(particle, energy))
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+// testInnerStructHost, for any layout
+template <class L>
+void testInner(const L &A, L &C, const size_t n)
+{
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        C.at(&innerStruct::x, idx) = A.at(&innerStruct::x, idx) + 10.f;
+        C.at(&innerStruct::y, idx) = A.at(&innerStruct::y, idx) + 20.f;
+    }
+}
+
+// the same, run by run
+template <class L>
+void testInnerRun(const L &A, L &C, const size_t n)
+{
+    const size_t s = L::step(&innerStruct::x);
+
+    for (size_t i = 0; i < n; i += A.run(i))
+    {
+        const size_t len = A.run(i);
+        const float *ax = &A.at(&innerStruct::x, i);
+        const float *ay = &A.at(&innerStruct::y, i);
+        float *cx = &C.at(&innerStruct::x, i);
+        float *cy = &C.at(&innerStruct::y, i);
+
+        for (size_t j = 0; j < len; j++)
+        {
+            cx[j * s] = ax[j * s] + 10.f;
+            cy[j * s] = ay[j * s] + 20.f;
+        }
+    }
+}
+
+// update one field in place; converges to 2 rather than underflowing
+template <class L>
+void testEnergy(L &P, const size_t n)
+{
+    const size_t s = L::step(&particle::energy);
+
+    for (size_t i = 0; i < n; i += P.run(i))
+    {
+        const size_t len = P.run(i);
+        float *e = &P.at(&particle::energy, i);
+
+        for (size_t j = 0; j < len; j++) e[j * s] = e[j * s] * 0.5f + 1.f;
+    }
+}
+
+template <class L>
+void runInner(const size_t n, const int nrep, const bool byRun)
+{
+    L A(n), C(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        innerStruct r;
+        r.x = (float)(rand() & 0xFF) / 100.0f;
+        r.y = (float)(rand() & 0xFF) / 100.0f;
+        A.set(i, r);
+    }
+
+    void (*kernel)(const L &, L &, const size_t) =
+        byRun ? testInnerRun<L> : testInner<L>;
+
+    kernel(A, C, n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        innerStruct a = A.get(i), c = C.get(i);
+
+        if (c.x != a.x + 10.f || c.y != a.y + 20.f)
+        {
+            printf("different on %zuth element\n", i);
+            break;
+        }
+    }
+
+    // alternate the direction so that no pass repeats the previous one
+    double iStart = seconds();
+
+    for (int k = 0; k < nrep; k++)
+    {
+        if (k & 1)
+            kernel(C, A, n);
+        else
+            kernel(A, C, n);
+    }
+
+    double iElaps = (seconds() - iStart) / nrep;
+
+    printf("  %s %9.6f ms %8.2f GB/s\n", L::name(), iElaps * 1e3,
+           4.0 * n * sizeof(float) / 1e9 / iElaps);
+}
+
+template <class L>
+void runEnergy(const size_t n, const int nrep)
+{
+    L P(n);
+    float *ref = (float *)malloc(n * sizeof(float));
+
+    for (size_t i = 0; i < n; i++)
+    {
+        particle p;
+        p.x = p.y = p.z = (float)i;
+        p.vx = p.vy = p.vz = 1.0f;
+        p.mass = 2.0f;
+        p.energy = (float)(rand() & 0xFF);
+        P.set(i, p);
+        ref[i] = p.energy * 0.5f + 1.f;
+    }
+
+    testEnergy(P, n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (P.at(&particle::energy, i) != ref[i] ||
+                P.get(i).x != (float)i)
+        {
+            printf("different on %zuth element\n", i);
+            break;
+        }
+    }
+
+    free(ref);
+
+    double iStart = seconds();
+
+    for (int k = 0; k < nrep; k++) testEnergy(P, n);
+
+    double iElaps = (seconds() - iStart) / nrep;
+
+    printf("  %s %9.6f ms %8.2f GB/s\n", L::name(), iElaps * 1e3,
+           2.0 * n * sizeof(float) / 1e9 / iElaps);
+}
+
+int main(int argc, char **argv)
+{
+    // smallest and largest array size, as powers of two
+    int lo = 10, hi = 22;
+
+    if (argc > 1) lo = atoi(argv[1]);
+
+    if (argc > 2) hi = atoi(argv[2]);
+
+    printf("%s layouts for innerStruct {x, y}: C.x = A.x + 10, C.y = A.y + 20"
+           "\n", argv[0]);
+
+    for (int p = lo; p <= hi; p++)
+    {
+        size_t n = (size_t)1 << p;
+
+        // about 2^26 elements in total per layout, so small sizes repeat
+        int nrep = (int)(((size_t)1 << 26) / n);
+
+        if (nrep < 1) nrep = 1;
+
+        printf("nElem %zu (%.2f MB per array)\n", n,
+               n * sizeof(innerStruct) / (1024.0 * 1024.0));
+        for (int byRun = 0; byRun < 2; byRun++)
+        {
+            printf(" %s\n", byRun ? "run by run" : "record by record");
+            runInner<AoS<innerStruct> >(n, nrep, byRun);
+            runInner<SoA<innerStruct> >(n, nrep, byRun);
+            runInner<AoSoA<innerStruct, 8> >(n, nrep, byRun);
+            runInner<AoSoA<innerStruct, 16> >(n, nrep, byRun);
+        }
+    }
+
+    printf("layouts for particle (32 bytes): energy = energy * 0.5 + 1\n");
+
+    for (int p = lo; p <= hi; p++)
+    {
+        size_t n = (size_t)1 << p;
+        int nrep = (int)(((size_t)1 << 26) / n);
+
+        if (nrep < 1) nrep = 1;
+
+        printf("nElem %zu (%.2f MB)\n", n,
+               n * sizeof(particle) / (1024.0 * 1024.0));
+        runEnergy<AoS<particle> >(n, nrep);
+        runEnergy<SoA<particle> >(n, nrep);
+        runEnergy<AoSoA<particle, 8> >(n, nrep);
+        runEnergy<AoSoA<particle, 16> >(n, nrep);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include "../common/common.h"
+#include "../common/transpose.h"
 #include <cuda_runtime.h>
 #include <stdio.h>
 
@@ -54,15 +55,10 @@ void checkResult(float *hostRef, float *gpuRef, const int size, int showme)
     if (!match)  printf("Arrays do not match.\n\n");
 }
 
+// blocked transpose from common/transpose.h; the naive loop thrashes the TLB
 void transposeHost(float *out, float *in, const int nx, const int ny)
 {
-    for( int iy = 0; iy < ny; ++iy)
-    {
-        for( int ix = 0; ix < nx; ++ix)
-        {
-            out[ix * ny + iy] = in[iy * nx + ix];
-        }
-    }
+    transposeTiled(out, in, nx, ny);
 }
 
 __global__ void warmup(float *out, float *in, const int nx, const int ny)
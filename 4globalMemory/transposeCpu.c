@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "../common/transpose.h"
+
+/*
+ * Host counterpart of transpose.cu: the transposes in common/transpose.h
+ * timed with the same effective bandwidth metric (bytes read plus bytes
+ * written per second). Kernels 0 and 1 copy rows and columns to bracket
+ * the achievable bandwidth, 2 and 3 are the naive loops, 4 - 6 the
+ * recursive, tiled and threaded versions and 7 - 8 the in-place ones (on
+ * an nx x nx matrix). Every transpose is checked against transposeHost.
+ */
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+void initialData(float *in,  const int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        in[i] = (float)( rand() & 0xFF ) / 10.0f; //100.0f;
+    }
+
+    return;
+}
+
+void checkResult(float *hostRef, float *cpuRef, const int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        if (hostRef[i] != cpuRef[i])
+        {
+            printf("different on %dth element: host %f cpu %f\n", i,
+                   hostRef[i], cpuRef[i]);
+            printf("Arrays do not match.\n\n");
+            return;
+        }
+    }
+}
+
+void transposeHost(float *out, float *in, const int nx, const int ny)
+{
+    for( int iy = 0; iy < ny; ++iy)
+    {
+        for( int ix = 0; ix < nx; ++ix)
+        {
+            out[ix * ny + iy] = in[iy * nx + ix];
+        }
+    }
+}
+
+void copyRow(float *out, float *in, const int nx, const int ny)
+{
+    for (int iy = 0; iy < ny; ++iy)
+    {
+        memcpy(out + (size_t)iy * nx, in + (size_t)iy * nx,
+               nx * sizeof(float));
+    }
+}
+
+void copyCol(float *out, float *in, const int nx, const int ny)
+{
+    for (int ix = 0; ix < nx; ++ix)
+    {
+        for (int iy = 0; iy < ny; ++iy)
+        {
+            out[(size_t)iy * nx + ix] = in[(size_t)iy * nx + ix];
+        }
+    }
+}
+
+void naiveCol(float *out, float *in, const int nx, const int ny)
+{
+    for (int ix = 0; ix < nx; ++ix)
+    {
+        for (int iy = 0; iy < ny; ++iy)
+        {
+            out[(size_t)ix * ny + iy] = in[(size_t)iy * nx + ix];
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // set up array size 4096
+    int nx = 1 << 12;
+    int ny = 1 << 12;
+
+    // select a kernel and thread count
+    int iKernel = 4;
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (argc > 1) iKernel  = atoi(argv[1]);
+
+    if (argc > 2) nthreads = atoi(argv[2]);
+
+    if (argc > 3) nx  = atoi(argv[3]);
+
+    if (argc > 4) ny  = atoi(argv[4]);
+
+    // in place needs a square matrix
+    if (iKernel >= 7) ny = nx;
+
+    printf("%s starting transpose with matrix nx %d ny %d with kernel %d "
+           "threads %d\n", argv[0], nx, ny, iKernel, nthreads);
+    size_t nBytes = (size_t)nx * ny * sizeof(float);
+
+    // allocate host memory
+    float *h_A = (float *)malloc(nBytes);
+    float *hostRef = (float *)malloc(nBytes);
+    float *cpuRef  = (float *)malloc(nBytes);
+
+    // initialize host array
+    initialData(h_A, nx * ny);
+
+    // reference transpose
+    transposeHost(hostRef, h_A, nx, ny);
+
+    // warmup: fault in the output pages before timing
+    double iStart = seconds();
+    copyRow(cpuRef, h_A, nx, ny);
+    double iElaps = seconds() - iStart;
+    printf("warmup         elapsed %f sec\n", iElaps);
+
+    const char *kernelName;
+
+    iStart = seconds();
+
+    switch (iKernel)
+    {
+    case 0:
+        kernelName = "CopyRow       ";
+        copyRow(cpuRef, h_A, nx, ny);
+        break;
+
+    case 1:
+        kernelName = "CopyCol       ";
+        copyCol(cpuRef, h_A, nx, ny);
+        break;
+
+    case 2:
+        kernelName = "NaiveRow      ";
+        transposeNaive(cpuRef, h_A, nx, ny);
+        break;
+
+    case 3:
+        kernelName = "NaiveCol      ";
+        naiveCol(cpuRef, h_A, nx, ny);
+        break;
+
+    case 4:
+        kernelName = "Tiled         ";
+        transposeTiled(cpuRef, h_A, nx, ny);
+        break;
+
+    case 5:
+        kernelName = "Recursive     ";
+        transposeRecursive(cpuRef, h_A, nx, ny);
+        break;
+
+    case 6:
+        kernelName = "Parallel      ";
+        transposeParallel(cpuRef, h_A, nx, ny, nthreads);
+        break;
+
+    case 7:
+    case 8:
+        // the copy is not timed
+        memcpy(cpuRef, h_A, nBytes);
+        iStart = seconds();
+
+        if (iKernel == 7)
+        {
+            kernelName = "InPlace       ";
+            transposeInPlace(cpuRef, nx);
+        }
+        else
+        {
+            kernelName = "InPlacePar    ";
+            transposeInPlaceParallel(cpuRef, nx, nthreads);
+        }
+
+        break;
+
+    default:
+        fprintf(stderr, "unknown kernel %d\n", iKernel);
+        exit(EXIT_FAILURE);
+    }
+
+    iElaps = seconds() - iStart;
+
+    // calculate effective_bandwidth
+    float ibnd = 2 * (double)nBytes / 1e9 / iElaps;
+    printf("%s elapsed %f sec effective bandwidth %f GB\n", kernelName,
+           iElaps, ibnd);
+
+    // check kernel results
+    if (iKernel > 1) checkResult(hostRef, cpuRef, nx * ny);
+
+    free(h_A);
+    free(hostRef);
+    free(cpuRef);
+
+    return EXIT_SUCCESS;
+}
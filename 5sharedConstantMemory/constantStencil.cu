@@ -1,6 +1,8 @@
 #include "../common/common.h"
+#include "../common/stencil.h"
 #include <cuda_runtime.h>
 #include <stdio.h>
+#include <unistd.h>
 
 /*
  * An example of using constant memory to optimize performance of a stencil
@@ -45,16 +47,12 @@ void setup_coef_constant (void)
     CHECK(cudaMemcpyToSymbol( coef, h_coef, (RADIUS + 1) * sizeof(float)));
 }
 
+// points RADIUS <= i < isize + RADIUS, the ones stencil_1d writes
 void cpu_stencil_1d (float *in, float *out, int isize)
 {
-    for (int i = RADIUS; i <= isize; i++)
-    {
-        float tmp = a1 * (in[i + 1] - in[i - 1])
-                    + a2 * (in[i + 2] - in[i - 2])
-                    + a3 * (in[i + 3] - in[i - 3])
-                    + a4 * (in[i + 4] - in[i - 4]);
-        out[i] = tmp;
-    }
+    const float h_coef[] = {a0, a1, a2, a3, a4};
+    stencilApply1d(out, in, RADIUS, isize + RADIUS, RADIUS, h_coef,
+                   STENCIL_ODD, (int)sysconf(_SC_NPROCESSORS_ONLN));
 }
 
 void checkResult(float *hostRef, float *gpuRef, const int size)
@@ -175,7 +173,7 @@ int main(int argc, char **argv)
     cpu_stencil_1d(h_in, hostRef, isize);
 
     // check results
-    checkResult(hostRef, gpuRef, isize);
+    checkResult(hostRef, gpuRef, isize + RADIUS);
 
     // print out results
     if(iprint)
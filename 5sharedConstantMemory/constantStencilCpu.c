@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "../common/stencil.h"
+
+/*
+ * Host counterpart of constantStencil.cu. The RADIUS = 4 first-derivative
+ * stencil over 16M points is computed by cpu_stencil_1d, the scalar loop of
+ * constantStencil.cu, and by the engine in common/stencil.h on one and on
+ * all threads. The 2D star of simple2DFD.cu is timed the same way on a
+ * 4096 x 4096 grid. Every version is reported with its effective bandwidth,
+ * one read and one write of every point, averaged over NREP runs, and
+ * checked against the scalar loop.
+ */
+
+#define RADIUS 4
+
+// timed runs of every version
+#define NREP   5
+
+// FD coeffecient
+#define a0     0.00000f
+#define a1     0.80000f
+#define a2    -0.20000f
+#define a3     0.03809f
+#define a4    -0.00357f
+
+// the __constant__ coef array of constantStencil.cu
+static const float coef[RADIUS + 1] = {a0, a1, a2, a3, a4};
+
+// the 2D coefficients of simple2DFD.cu
+static const float coef2d[RADIUS + 1] = {-3.0124472f, 1.7383092f,
+                                         -0.2796695f, 0.0547837f,
+                                         -0.0073118f
+                                        };
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+void initialData(float *in,  const int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        in[i] = (float)(rand() & 0xFF) / 100.0f;
+    }
+}
+
+// points RADIUS <= i < isize + RADIUS, the ones stencil_1d writes
+void cpu_stencil_1d (float *in, float *out, int isize)
+{
+    for (int i = RADIUS; i < isize + RADIUS; i++)
+    {
+        float tmp = a1 * (in[i + 1] - in[i - 1])
+                    + a2 * (in[i + 2] - in[i - 2])
+                    + a3 * (in[i + 3] - in[i - 3])
+                    + a4 * (in[i + 4] - in[i - 4]);
+        out[i] = tmp;
+    }
+}
+
+// the 2D star, one point at a time
+void cpu_stencil_2d(float *in, float *out, int nx, int ny)
+{
+    for (int iy = RADIUS; iy < ny - RADIUS; iy++)
+    {
+        for (int ix = RADIUS; ix < nx - RADIUS; ix++)
+        {
+            float *p = in + (size_t)iy * nx + ix;
+            float tmp = coef2d[0] * p[0] * 2.0f;
+
+            for (int d = 1; d <= RADIUS; d++)
+                tmp += coef2d[d] * (p[-d] + p[d]);
+
+            for (int d = 1; d <= RADIUS; d++)
+                tmp += coef2d[d] * (p[-d * nx] + p[d * nx]);
+
+            out[(size_t)iy * nx + ix] = tmp;
+        }
+    }
+}
+
+void checkResult(float *hostRef, float *engRef, const int lo, const int hi)
+{
+    double epsilon = 1.0E-5;
+    int match = 1;
+
+    for (int i = lo; i < hi; i++)
+    {
+        if (fabs(hostRef[i] - engRef[i]) > epsilon * (1.0 + fabs(hostRef[i])))
+        {
+            match = 0;
+            printf("different on %dth element: host %f engine %f\n", i,
+                   hostRef[i], engRef[i]);
+            break;
+        }
+    }
+
+    if (!match) printf("Arrays do not match.\n\n");
+}
+
+void report(const char *name, double iElaps, double bytes)
+{
+    printf("%s elapsed %f sec %8.2f GB/s\n", name, iElaps, bytes / 1e9 /
+           iElaps);
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int isize = 1 << 24;
+    int nx = 4096, ny = 4096;
+
+    if (argc > 1) nthreads = atoi(argv[1]);
+
+    if (argc > 2) isize = atoi(argv[2]);
+
+    printf("%s 1D array size: %d 2D grid: %d x %d threads: %d\n", argv[0],
+           isize, nx, ny, nthreads);
+
+    size_t nBytes = (isize + 2 * RADIUS) * sizeof(float);
+    float *h_in    = (float *)malloc(nBytes);
+    float *hostRef = (float *)malloc(nBytes);
+    float *engRef  = (float *)malloc(nBytes);
+
+    // touch the outputs, so the first run does not time page faults
+    initialData(h_in, isize + 2 * RADIUS);
+    memset(hostRef, 0, nBytes);
+    memset(engRef, 0, nBytes);
+
+    double iStart, iElaps;
+    double bytes = 2.0 * isize * sizeof(float);
+
+    // 1D: scalar loop, then the engine
+    iStart = seconds();
+
+    for (int k = 0; k < NREP; k++)
+        cpu_stencil_1d(h_in, hostRef, isize);
+
+    iElaps = (seconds() - iStart) / NREP;
+    report("1d scalar     ", iElaps, bytes);
+
+    iStart = seconds();
+
+    for (int k = 0; k < NREP; k++)
+        stencilApply1d(engRef, h_in, RADIUS, isize + RADIUS, RADIUS, coef,
+                       STENCIL_ODD, 1);
+
+    iElaps = (seconds() - iStart) / NREP;
+    report("1d engine     ", iElaps, bytes);
+    checkResult(hostRef, engRef, RADIUS, isize + RADIUS);
+
+    iStart = seconds();
+
+    for (int k = 0; k < NREP; k++)
+        stencilApply1d(engRef, h_in, RADIUS, isize + RADIUS, RADIUS, coef,
+                       STENCIL_ODD, nthreads);
+
+    iElaps = (seconds() - iStart) / NREP;
+    report("1d threads    ", iElaps, bytes);
+    checkResult(hostRef, engRef, RADIUS, isize + RADIUS);
+
+    free(h_in);
+    free(hostRef);
+    free(engRef);
+
+    // 2D
+    size_t nxy = (size_t)nx * ny;
+    h_in    = (float *)malloc(nxy * sizeof(float));
+    hostRef = (float *)malloc(nxy * sizeof(float));
+    engRef  = (float *)malloc(nxy * sizeof(float));
+
+    initialData(h_in, (int)nxy);
+    memset(hostRef, 0, nxy * sizeof(float));
+    memset(engRef, 0, nxy * sizeof(float));
+    bytes = 2.0 * (nx - 2 * RADIUS) * (ny - 2 * RADIUS) * sizeof(float);
+
+    iStart = seconds();
+
+    for (int k = 0; k < NREP; k++)
+        cpu_stencil_2d(h_in, hostRef, nx, ny);
+
+    iElaps = (seconds() - iStart) / NREP;
+    report("2d scalar     ", iElaps, bytes);
+
+    iStart = seconds();
+
+    for (int k = 0; k < NREP; k++)
+        stencilApply2d(engRef, h_in, nx, ny, RADIUS, coef2d, 1);
+
+    iElaps = (seconds() - iStart) / NREP;
+    report("2d engine     ", iElaps, bytes);
+    checkResult(hostRef, engRef, 0, (int)nxy);
+
+    iStart = seconds();
+
+    for (int k = 0; k < NREP; k++)
+        stencilApply2d(engRef, h_in, nx, ny, RADIUS, coef2d, nthreads);
+
+    iElaps = (seconds() - iStart) / NREP;
+    report("2d threads    ", iElaps, bytes);
+    checkResult(hostRef, engRef, 0, (int)nxy);
+
+    free(h_in);
+    free(hostRef);
+    free(engRef);
+
+    return EXIT_SUCCESS;
+}
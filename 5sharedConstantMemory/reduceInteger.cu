@@ -1,4 +1,5 @@
 #include "../common/common.h"
+#include "../common/reduce.h"
 #include <cuda_runtime.h>
 #include <stdio.h>
 #define DIM 128
@@ -11,19 +12,6 @@
 
 extern __shared__ int dsmem[];
 
-// Recursive Implementation of Interleaved Pair Approach
-int recursiveReduce(int *data, int const size)
-{
-    if (size == 1) return data[0];
-
-    int const stride = size / 2;
-
-    for (int i = 0; i < stride; i++)
-        data[i] += data[i + stride];
-
-    return recursiveReduce(data, stride);
-}
-
 // unroll4 + complete unroll for loop + gmem
 __global__ void reduceGmem(int *g_idata, int *g_odata, unsigned int n)
 {
@@ -433,7 +421,6 @@ int main(int argc, char **argv)
     size_t bytes = size * sizeof(int);
     int *h_idata = (int *) malloc(bytes);
     int *h_odata = (int *) malloc(grid.x * sizeof(int));
-    int *tmp     = (int *) malloc(bytes);
 
     // initialize the array
     for (int i = 0; i < size; i++)
@@ -441,8 +428,6 @@ int main(int argc, char **argv)
         h_idata[i] = (int)( rand() & 0xFF );
     }
 
-    memcpy (tmp, h_idata, bytes);
-
     int gpu_sum = 0;
 
     // allocate device memory
@@ -452,7 +437,7 @@ int main(int argc, char **argv)
     CHECK(cudaMalloc((void **) &d_odata, grid.x * sizeof(int)));
 
     // cpu reduction
-    int cpu_sum = recursiveReduce (tmp, size);
+    int cpu_sum = reduceSum(h_idata, size);
     printf("cpu reduce          : %d\n", cpu_sum);
 
     // reduce gmem
@@ -1,4 +1,5 @@
 #include "../common/common.h"
+#include "../common/reduce.h"
 #include <cuda_runtime.h>
 #include <stdio.h>
 
@@ -10,19 +11,6 @@
 #define DIM     128
 #define SMEMDIM 4     // 128/32 = 8 
 
-// Recursive Implementation of Interleaved Pair Approach
-int recursiveReduce(int *data, int const size)
-{
-    if (size == 1) return data[0];
-
-    int const stride = size / 2;
-
-    for (int i = 0; i < stride; i++)
-        data[i] += data[i + stride];
-
-    return recursiveReduce(data, stride);
-}
-
 __global__ void reduceSmem (int *g_idata, int *g_odata, unsigned int n)
 {
     __shared__ int smem[DIM];
@@ -291,14 +279,11 @@ int main(int argc, char **argv)
     size_t bytes = size * sizeof(int);
     int *h_idata = (int *) malloc(bytes);
     int *h_odata = (int *) malloc(grid.x * sizeof(int));
-    int *tmp     = (int *) malloc(bytes);
 
     // initialize the array
     for (int i = 0; i < size; i++)
         h_idata[i] = (int)( rand() & 0xFF );
 
-    memcpy (tmp, h_idata, bytes);
-
     int gpu_sum = 0;
 
     // allocate device memory
@@ -308,7 +293,7 @@ int main(int argc, char **argv)
     CHECK(cudaMalloc((void **) &d_odata, grid.x * sizeof(int)));
 
     // cpu reduction
-    int cpu_sum = recursiveReduce (tmp, size);
+    int cpu_sum = reduceSum(h_idata, size);
     printf("cpu reduce          : %d\n", cpu_sum);
 
     // reduce smem
@@ -1,4 +1,5 @@
 #include "common.h"
+#include "../common/transpose.h"
 #include <cuda_runtime.h>
 #include <stdio.h>
 
@@ -60,15 +61,10 @@ void checkResult(float *hostRef, float *gpuRef, int rows, int cols)
     if (!match)  printf("Arrays do not match.\n\n");
 }
 
+// blocked transpose from common/transpose.h; the naive loop thrashes the TLB
 void transposeHost(float *out, float *in, const int nrows, const int ncols)
 {
-    for (int iy = 0; iy < nrows; ++iy)
-    {
-        for (int ix = 0; ix < ncols; ++ix)
-        {
-            out[INDEX(ix, iy, nrows)] = in[INDEX(iy, ix, ncols)];
-        }
-    }
+    transposeTiled(out, in, ncols, nrows);
 }
 
 __global__ void copyGmem(float *out, float *in, const int nrows, const int ncols)
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include "../common/taskgraph.h"
+
+/*
+ * The stream patterns of simpleHyperqDepth.cu, simpleHyperqBreadth.cu,
+ * simpleHyperqDependence.cu and simpleCallback.cu on the host task graph in
+ * common/taskgraph.h. n_streams streams each run kernel_1 .. kernel_4,
+ * submitted depth first or breadth first; then the last stream waits on an
+ * event recorded at the end of every other stream; then every stream ends
+ * with a callback.
+ *
+ * A second pass submits ntiny empty tasks per stream, depth first and then
+ * breadth first, and reports what the graph itself costs: submissions per
+ * second and the mean time from a task becoming ready to starting. Depth
+ * first leaves one ready task per stream at a time, which the workers
+ * trade by stealing; breadth first readies one task of every stream at
+ * once.
+ */
+
+#define N 300000
+#define NSTREAM 4
+
+// tasks per stream for the scheduling pass
+#define NTINY 10000
+
+void kernel_1(void *arg)
+{
+    (void)arg;
+    volatile double sum = 0.0;
+
+    for(int i = 0; i < N; i++)
+    {
+        sum = sum + tan(0.1) * tan(0.1);
+    }
+}
+
+void kernel_2(void *arg)
+{
+    (void)arg;
+    volatile double sum = 0.0;
+
+    for(int i = 0; i < N; i++)
+    {
+        sum = sum + tan(0.1) * tan(0.1);
+    }
+}
+
+void kernel_3(void *arg)
+{
+    (void)arg;
+    volatile double sum = 0.0;
+
+    for(int i = 0; i < N; i++)
+    {
+        sum = sum + tan(0.1) * tan(0.1);
+    }
+}
+
+void kernel_4(void *arg)
+{
+    (void)arg;
+    volatile double sum = 0.0;
+
+    for(int i = 0; i < N; i++)
+    {
+        sum = sum + tan(0.1) * tan(0.1);
+    }
+}
+
+void kernel_empty(void *arg)
+{
+    (void)arg;
+}
+
+void my_callback(TaskStream *stream, void *data)
+{
+    (void)stream;
+    printf("callback from stream %d\n", *((int *)data));
+}
+
+static const TaskFn kernels[4] = { kernel_1, kernel_2, kernel_3, kernel_4 };
+
+void report(TaskPool *pool, const char *name, TaskEvent *start,
+            TaskEvent *stop)
+{
+    long ntasks, nstolen;
+    double wait;
+
+    taskPoolStats(pool, &ntasks, &nstolen, &wait);
+    printf("%-12s %8.3f ms  %6ld tasks %6ld stolen  %8.2f us ready to "
+           "start\n", name, taskEventElapsedTime(start, stop), ntasks,
+           nstolen, wait * 1e6);
+    taskPoolResetStats(pool);
+}
+
+int main(int argc, char **argv)
+{
+    int n_streams = NSTREAM;
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int ntiny = NTINY;
+
+    // get argument from command line
+    if (argc > 1) n_streams = atoi(argv[1]);
+
+    if (argc > 2) nthreads = atoi(argv[2]);
+
+    if (argc > 3) ntiny = atoi(argv[3]);
+
+    printf("> %s with num_streams %d on %d worker threads\n", argv[0],
+           n_streams, nthreads);
+
+    TaskPool *pool = taskPoolCreate(nthreads);
+
+    // Allocate and initialize an array of stream handles
+    TaskStream **streams = (TaskStream **)malloc(n_streams *
+                           sizeof(TaskStream *));
+    TaskEvent **kernelEvent = (TaskEvent **)malloc(n_streams *
+                              sizeof(TaskEvent *));
+    int *stream_ids = (int *)malloc(n_streams * sizeof(int));
+
+    for (int i = 0 ; i < n_streams ; i++)
+    {
+        streams[i] = taskStreamCreate(pool);
+        kernelEvent[i] = taskEventCreate(pool);
+        stream_ids[i] = i;
+    }
+
+    // the timing events go on a stream of their own, which waits for all
+    TaskStream *timer = taskStreamCreate(pool);
+    TaskEvent *start = taskEventCreate(pool);
+    TaskEvent *stop = taskEventCreate(pool);
+
+    for (int pattern = 0; pattern < 4; pattern++)
+    {
+        taskEventRecord(start, timer);
+
+        if (pattern == 1)
+        {
+            // breadth first
+            for (int k = 0; k < 4; k++)
+                for (int i = 0; i < n_streams; i++)
+                    taskLaunch(streams[i], kernels[k], NULL);
+        }
+        else
+        {
+            // depth first
+            for (int i = 0; i < n_streams; i++)
+            {
+                for (int k = 0; k < 4; k++)
+                    taskLaunch(streams[i], kernels[k], NULL);
+
+                if (pattern == 2)
+                {
+                    // queued before the last stream's kernels, which then
+                    // wait for all the others
+                    taskEventRecord(kernelEvent[i], streams[i]);
+                    taskStreamWaitEvent(streams[n_streams - 1],
+                                        kernelEvent[i]);
+                }
+            }
+        }
+
+        if (pattern == 3)
+        {
+            for (int i = 0; i < n_streams; i++)
+                taskStreamAddCallback(streams[i], my_callback,
+                                      (void *)(stream_ids + i));
+        }
+
+        for (int i = 0; i < n_streams; i++)
+        {
+            taskEventRecord(kernelEvent[i], streams[i]);
+            taskStreamWaitEvent(timer, kernelEvent[i]);
+        }
+
+        taskEventRecord(stop, timer);
+        taskEventSynchronize(stop);
+
+        report(pool, pattern == 0 ? "depth" : pattern == 1 ? "breadth" :
+               pattern == 2 ? "dependence" : "callback", start, stop);
+    }
+
+    // scheduling cost: empty tasks
+    printf("> %d empty tasks per stream\n", ntiny);
+
+    for (int breadth = 0; breadth < 2; breadth++)
+    {
+        double iStart = taskSeconds();
+        taskEventRecord(start, timer);
+
+        if (breadth)
+        {
+            for (int k = 0; k < ntiny; k++)
+                for (int i = 0; i < n_streams; i++)
+                    taskLaunch(streams[i], kernel_empty, NULL);
+        }
+        else
+        {
+            for (int i = 0; i < n_streams; i++)
+                for (int k = 0; k < ntiny; k++)
+                    taskLaunch(streams[i], kernel_empty, NULL);
+        }
+
+        double iSubmit = taskSeconds() - iStart;
+
+        for (int i = 0; i < n_streams; i++)
+        {
+            taskEventRecord(kernelEvent[i], streams[i]);
+            taskStreamWaitEvent(timer, kernelEvent[i]);
+        }
+
+        taskEventRecord(stop, timer);
+        taskEventSynchronize(stop);
+
+        printf("%-12s %8.2f Mtasks/s submitted\n", breadth ? "breadth" :
+               "depth", (double)ntiny * n_streams / iSubmit * 1e-6);
+        report(pool, breadth ? "breadth" : "depth", start, stop);
+    }
+
+    // release all stream
+    for (int i = 0 ; i < n_streams ; i++)
+    {
+        taskStreamDestroy(streams[i]);
+        taskEventDestroy(kernelEvent[i]);
+    }
+
+    taskStreamDestroy(timer);
+    taskEventDestroy(start);
+    taskEventDestroy(stop);
+    taskPoolDestroy(pool);
+
+    free(streams);
+    free(kernelEvent);
+    free(stream_ids);
+
+    return 0;
+}
@@ -109,6 +109,7 @@ static void h_nbody_update_velocity(real *px, real *py,
 
     if (v > MAX_SPEED)
     {
+        #pragma omp atomic
         *exceeded_speed = *exceeded_speed + 1;
     }
 }
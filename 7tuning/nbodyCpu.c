@@ -0,0 +1,339 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+/*
+ * Host version of nbody.cu built on the engine in common/nbody.h: tiled,
+ * symmetric pair updates in AVX registers over OpenMP threads, or with a
+ * positive opening angle theta on the command line, the Barnes-Hut
+ * quadtree. The same -DSINGLE_PREC / -DDOUBLE_PREC flags select the
+ * floating-point type.
+ *
+ * Up to DIRECT_MAX bodies, one step of h_nbody_update_velocity's direct
+ * loop (one body at a time, % N wraparound, libm POW / SQRT) is timed as
+ * the baseline and used to check the engine's accelerations. Both are
+ * reported in body-body interactions per second, N * (N - 1) per step; the
+ * engine evaluates each pair once for two of those.
+ *
+ * The first step is then timed for all pairs and for the tree at a few
+ * opening angles, with the error against exact (double-precision) sums on
+ * a sample of bodies, before niters steps of the chosen mode.
+ */
+
+// largest N for the all-pairs baseline and comparison
+#define DIRECT_MAX  65536
+
+// bodies with exact accelerations for the error estimates
+#define NSAMPLE     1000
+
+#ifndef SINGLE_PREC
+#ifndef DOUBLE_PREC
+#define SINGLE_PREC
+#endif
+#endif
+
+#ifdef SINGLE_PREC
+
+typedef float real;
+#define MAX_DIST    200.0f
+#define MAX_SPEED   100.0f
+#define MASS        2.0f
+#define DT          0.00001f
+#define LIMIT_DIST  0.000001f
+#define POW(x,y)    powf(x,y)
+#define SQRT(x)     sqrtf(x)
+
+#else // SINGLE_PREC
+
+typedef double real;
+#define MAX_DIST    200.0
+#define MAX_SPEED   100.0
+#define MASS        2.0
+#define DT          0.00001
+#define LIMIT_DIST  0.000001
+#define POW(x,y)    pow(x,y)
+#define SQRT(x)     sqrt(x)
+
+#endif // SINGLE_PREC
+
+#include "../common/nbody.h"
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+// the force loop of h_nbody_update_velocity
+static void ref_accel(real *px, real *py, real *ax, real *ay, int N, int id)
+{
+    real total_ax = 0.0f;
+    real total_ay = 0.0f;
+
+    real my_x = px[id];
+    real my_y = py[id];
+
+    int i = (id + 1) % N;
+
+    while (i != id)
+    {
+        real rx = px[i] - my_x;
+        real ry = py[i] - my_y;
+
+        real dist2 = rx * rx + ry * ry;
+
+        if (dist2 < LIMIT_DIST)
+        {
+            dist2 = LIMIT_DIST;
+        }
+
+        real dist6 = dist2 * dist2 * dist2;
+        real s = MASS * (1.0f / SQRT(dist6));
+        total_ax += rx * s;
+        total_ay += ry * s;
+
+        i = (i + 1) % N;
+    }
+
+    ax[id] = total_ax;
+    ay[id] = total_ay;
+}
+
+// velocity and position updates of nbody.cu from the accelerations
+static void update(real *px, real *py, real *vx, real *vy, real *ax,
+                   real *ay, int N, int *exceeded_speed, int *beyond_bounds)
+{
+    int exceeded = 0, beyond = 0;
+    int i;
+
+    #pragma omp parallel for reduction(+:exceeded, beyond)
+    for (i = 0; i < N; i++)
+    {
+        vx[i] = vx[i] + ax[i];
+        vy[i] = vy[i] + ay[i];
+
+        real v = SQRT(POW(vx[i], 2.0) + POW(vy[i], 2.0));
+
+        if (v > MAX_SPEED) exceeded++;
+
+        px[i] += (vx[i] * DT);
+        py[i] += (vy[i] * DT);
+
+        real dist = SQRT(POW(px[i], 2.0) + POW(py[i], 2.0));
+
+        if (dist > MAX_DIST) beyond = 1;
+    }
+
+    *exceeded_speed = exceeded;
+    *beyond_bounds = beyond > 0;
+}
+
+// exact acceleration of body id, in double
+static void exact_accel(real *px, real *py, int N, int id, double *ax,
+                        double *ay)
+{
+    double total_ax = 0.0, total_ay = 0.0;
+
+    for (int i = 0; i < N; i++)
+    {
+        if (i == id) continue;
+
+        double rx = (double)px[i] - px[id];
+        double ry = (double)py[i] - py[id];
+        double dist2 = rx * rx + ry * ry;
+
+        if (dist2 < LIMIT_DIST) dist2 = LIMIT_DIST;
+
+        double s = MASS / (dist2 * sqrt(dist2));
+        total_ax += rx * s;
+        total_ay += ry * s;
+    }
+
+    *ax = total_ax;
+    *ay = total_ay;
+}
+
+// relative error of ax, ay on the sample
+static double sample_error(real *ax, real *ay, int *sample, double *ex,
+                           double *ey, int nsample)
+{
+    double err = 0.0, norm = 0.0;
+
+    for (int k = 0; k < nsample; k++)
+    {
+        err  += fabs(ax[sample[k]] - ex[k]) + fabs(ay[sample[k]] - ey[k]);
+        norm += fabs(ex[k]) + fabs(ey[k]);
+    }
+
+    return err / norm;
+}
+
+static void print_points(real *x, real *y, int N)
+{
+    int i;
+
+    for (i = 0; i < N; i++)
+    {
+        printf("%.20e %.20e\n", x[i], y[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int N = 30720;
+    int iter, niters = 10;
+    int exceeded_speed = 0, beyond_bounds = 0;
+
+    if (argc > 1) N = atoi(argv[1]);
+
+    if (argc > 2) niters = atoi(argv[2]);
+
+    real theta = 0;
+
+    if (argc > 3) theta = (real)atof(argv[3]);
+
+#ifdef SINGLE_PREC
+    printf("Using single-precision floating-point values\n");
+#else // SINGLE_PREC
+    printf("Using double-precision floating-point values\n");
+#endif // SINGLE_PREC
+
+    real *px = (real *)malloc(N * sizeof(real));
+    real *py = (real *)malloc(N * sizeof(real));
+    real *vx = (real *)calloc(N, sizeof(real));
+    real *vy = (real *)calloc(N, sizeof(real));
+    real *ax = (real *)calloc(N, sizeof(real));
+    real *ay = (real *)calloc(N, sizeof(real));
+
+    for (i = 0; i < N; i++)
+    {
+        px[i] = (rand() % 200) - 100;
+        py[i] = (rand() % 200) - 100;
+    }
+
+    NBody nb;
+    NBodyTree tree;
+
+    if (nbodyInit(&nb, N) != 0 || nbodyTreeInit(&tree, N) != 0)
+    {
+        fprintf(stderr, "cannot allocate force buffers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("N = %d bodies, %d threads, tile %d, theta %.2f\n", N,
+           nb.nthreads, NBODY_TILE, (double)theta);
+
+    double interactions = (double)N * (N - 1);
+    double start, ref_time = 0.0;
+
+    if (N <= DIRECT_MAX)
+    {
+        real *ref_ax = (real *)malloc(N * sizeof(real));
+        real *ref_ay = (real *)malloc(N * sizeof(real));
+
+        // baseline: one step of the direct loop
+        start = seconds();
+
+        #pragma omp parallel for
+        for (i = 0; i < N; i++) ref_accel(px, py, ref_ax, ref_ay, N, i);
+
+        ref_time = seconds() - start;
+        printf("direct loop   %f s/step %10.3e interactions/s\n", ref_time,
+               interactions / ref_time);
+
+        // check the first step against it
+        nbodyAccel(&nb, px, py, ax, ay, MASS, LIMIT_DIST);
+        double err = 0.0, norm = 0.0;
+
+        for (i = 0; i < N; i++)
+        {
+            err  += fabs((double)ax[i] - ref_ax[i]) +
+                    fabs((double)ay[i] - ref_ay[i]);
+            norm += fabs((double)ref_ax[i]) + fabs((double)ref_ay[i]);
+        }
+
+        printf("relative difference from the direct loop %.3e\n",
+               err / norm);
+        free(ref_ax);
+        free(ref_ay);
+    }
+
+    // accuracy against time on the first step
+    int nsample = N < NSAMPLE ? N : NSAMPLE;
+    int *sample = (int *)malloc(nsample * sizeof(int));
+    double *ex = (double *)malloc(nsample * sizeof(double));
+    double *ey = (double *)malloc(nsample * sizeof(double));
+
+    #pragma omp parallel for
+    for (int k = 0; k < nsample; k++)
+    {
+        sample[k] = (int)((long)k * N / nsample);
+        exact_accel(px, py, N, sample[k], &ex[k], &ey[k]);
+    }
+
+    printf("mode             s/step  relative error (%d bodies)\n", nsample);
+
+    if (N <= DIRECT_MAX)
+    {
+        start = seconds();
+        nbodyAccel(&nb, px, py, ax, ay, MASS, LIMIT_DIST);
+        printf("all pairs     %9.4f  %.3e\n", seconds() - start,
+               sample_error(ax, ay, sample, ex, ey, nsample));
+    }
+
+    const real thetas[] = { 0.25f, 0.5f, 0.75f, 1.0f };
+
+    for (int k = 0; k < 4; k++)
+    {
+        start = seconds();
+        nbodyTreeAccel(&tree, px, py, ax, ay, MASS, LIMIT_DIST, thetas[k]);
+        printf("tree %.2f     %9.4f  %.3e\n", (double)thetas[k],
+               seconds() - start,
+               sample_error(ax, ay, sample, ex, ey, nsample));
+    }
+
+    start = seconds();
+
+    for (iter = 0; iter < niters; iter++)
+    {
+        if (theta > 0)
+            nbodyTreeAccel(&tree, px, py, ax, ay, MASS, LIMIT_DIST, theta);
+        else
+            nbodyAccel(&nb, px, py, ax, ay, MASS, LIMIT_DIST);
+
+        update(px, py, vx, vy, ax, ay, N, &exceeded_speed, &beyond_bounds);
+    }
+
+    double exec_time = seconds() - start;
+
+    print_points(px, py, 10);
+    printf("Any points beyond bounds? %s, # points exceeded velocity %d/%d\n",
+           beyond_bounds > 0 ? "true" : "false", exceeded_speed, N);
+    printf("%s %f s/step %10.3e interactions/s", theta > 0 ?
+           "tree         " : "engine       ", exec_time / niters,
+           interactions * niters / exec_time);
+
+    if (ref_time > 0) printf(" (%.1fx)", ref_time * niters / exec_time);
+
+    printf("\n");
+    printf("Total execution time %f s\n", exec_time);
+
+    nbodyFree(&nb);
+    nbodyTreeFree(&tree);
+    free(sample);
+    free(ex);
+    free(ey);
+    free(px);
+    free(py);
+    free(vx);
+    free(vy);
+    free(ax);
+    free(ay);
+
+    return 0;
+}
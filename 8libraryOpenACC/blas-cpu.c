@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../common/gemm.h"
+
+/*
+ * sgemm_ and dgemm_ with the Fortran BLAS interface, on the engine in
+ * common/gemm.h: the host counterpart of the NVBLAS library drop-in.c is
+ * meant to be run with. Linked in place of the reference BLAS, as
+ *
+ *   gcc -o drop-in drop-in.c blas-cpu.c -lpthread
+ *
+ * or built into libblas-cpu.so and put ahead of libblas with LD_PRELOAD,
+ * the way NVBLAS intercepts the calls, it runs unchanged code on every
+ * core. Arguments are checked as the reference BLAS checks them; a bad
+ * one is reported with its position and the call does nothing.
+ *
+ * The threads are GEMM_NUM_THREADS from the environment, or one per
+ * online processor.
+ */
+
+static int blas_threads(void)
+{
+    static int nthreads = 0;
+
+    if (nthreads == 0)
+    {
+        const char *env = getenv("GEMM_NUM_THREADS");
+        int n = env != NULL ? atoi(env) : 0;
+
+        if (n < 1) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = n < 1 ? 1 : n;
+    }
+
+    return nthreads;
+}
+
+static int lsame(char a, char b)
+{
+    return a == b || a == b + 'a' - 'A';
+}
+
+// position of the first bad argument, as xerbla reports it, or 0
+static int gemm_check(const char *name, char ta, char tb, int m, int n,
+                      int k, int lda, int ldb, int ldc)
+{
+    int nrowa = lsame(ta, 'N') ? m : k;
+    int nrowb = lsame(tb, 'N') ? k : n;
+    int info = 0;
+
+    if (!lsame(ta, 'N') && !lsame(ta, 'T') && !lsame(ta, 'C'))
+        info = 1;
+    else if (!lsame(tb, 'N') && !lsame(tb, 'T') && !lsame(tb, 'C'))
+        info = 2;
+    else if (m < 0)
+        info = 3;
+    else if (n < 0)
+        info = 4;
+    else if (k < 0)
+        info = 5;
+    else if (lda < (nrowa > 1 ? nrowa : 1))
+        info = 8;
+    else if (ldb < (nrowb > 1 ? nrowb : 1))
+        info = 10;
+    else if (ldc < (m > 1 ? m : 1))
+        info = 13;
+
+    if (info != 0)
+    {
+        fprintf(stderr, " ** On entry to %s parameter number %d had an "
+                "illegal value\n", name, info);
+    }
+
+    return info;
+}
+
+int sgemm_(char *transa, char *transb, int *m, int *n, int *k,
+           float *alpha, float *a, int *lda, float *b, int *ldb,
+           float *beta, float *c, int *ldc)
+{
+    if (gemm_check("SGEMM ", *transa, *transb, *m, *n, *k, *lda, *ldb,
+                   *ldc) != 0)
+        return 0;
+
+    if (gemmS(*transa, *transb, *m, *n, *k, *alpha, a, *lda, b, *ldb, *beta,
+              c, *ldc, blas_threads()) != 0)
+    {
+        fprintf(stderr, "SGEMM: out of memory\n");
+    }
+
+    return 0;
+}
+
+int dgemm_(char *transa, char *transb, int *m, int *n, int *k,
+           double *alpha, double *a, int *lda, double *b, int *ldb,
+           double *beta, double *c, int *ldc)
+{
+    if (gemm_check("DGEMM ", *transa, *transb, *m, *n, *k, *lda, *ldb,
+                   *ldc) != 0)
+        return 0;
+
+    if (gemmD(*transa, *transb, *m, *n, *k, *alpha, a, *lda, b, *ldb, *beta,
+              c, *ldc, blas_threads()) != 0)
+    {
+        fprintf(stderr, "DGEMM: out of memory\n");
+    }
+
+    return 0;
+}
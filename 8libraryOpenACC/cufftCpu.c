@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "../common/fft.h"
+
+/*
+ * cufft.cu and cufft-multi.cu on the host, with the FFT in common/fft.h.
+ *
+ * The 1D forward transform of cufft.cu, N samples of cos(x) in steps of
+ * pi / 20 transformed in place, prints the same output and is checked
+ * against a DFT in double precision. The transform of cufft-multi.cu,
+ * 1024 samples in steps of pi / 4, is checked against its exact spectrum:
+ * 512 in bins 128 and 896 and nothing elsewhere. A batch of R2C
+ * transforms in place, on lines padded to N / 2 + 1 complex values, must
+ * give the same spectra as out of place.
+ *
+ * Then batch lines of N are timed as C2C and R2C on all threads and on one,
+ * and a single transform of LONG points with its passes split over the
+ * threads (what cufft-multi.cu gives two GPUs) against one thread. Rates
+ * are 5 N log2(N) flops per complex line and half that per real one.
+ */
+
+// transforms per timing
+#define NREP 10
+
+// points of the single long transform
+#define LONG (1 << 20)
+
+int nprints = 30;
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+/*
+ * Create N fake samplings along the function cos(x), in steps of delta.
+ */
+void generate_fake_samples(int N, double delta, float **out)
+{
+    int i;
+    float *result = (float *)malloc(sizeof(float) * N);
+
+    for (i = 0; i < N; i++)
+    {
+        result[i] = cos(i * delta);
+    }
+
+    *out = result;
+}
+
+void real_to_complex(float *r, FftComplex **complx, int N)
+{
+    int i;
+    (*complx) = (FftComplex *)malloc(sizeof(FftComplex) * N);
+
+    for (i = 0; i < N; i++)
+    {
+        (*complx)[i].x = r[i];
+        (*complx)[i].y = 0;
+    }
+}
+
+// largest distance from the DFT of the real samples x, over its largest bin
+double check_dft(const float *x, const FftComplex *X, int N)
+{
+    double maxErr = 0.0, maxRef = 0.0;
+
+    for (int k = 0; k < N; k++)
+    {
+        double re = 0.0, im = 0.0;
+
+        for (int j = 0; j < N; j++)
+        {
+            double t = -2.0 * FFT_PI * (double)((long)j * k % N) / N;
+            re += x[j] * cos(t);
+            im += x[j] * sin(t);
+        }
+
+        maxErr = fmax(maxErr, hypot(X[k].x - re, X[k].y - im));
+        maxRef = fmax(maxRef, hypot(re, im));
+    }
+
+    return maxErr / maxRef;
+}
+
+void report(const char *name, double iElaps, int n, int batch, double flops)
+{
+    printf("%-20s %9.3f ms %8.2f GFLOP/s\n", name, iElaps * 1e3,
+           flops * n * log2((double)n) * batch / 1e9 / iElaps);
+}
+
+// NREP executions of a plan after one to touch the output
+double time_exec(FftPlan *plan, void *in, void *out)
+{
+    double iStart = 0.0;
+
+    for (int r = -1; r < NREP; r++)
+    {
+        if (r == 0) iStart = seconds();
+
+        if (plan->type == FFT_R2C)
+            fftExecR2C(plan, (float *)in, (FftComplex *)out);
+        else
+            fftExecC2C(plan, (FftComplex *)in, (FftComplex *)out,
+                       FFT_FORWARD);
+    }
+
+    return (seconds() - iStart) / NREP;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int N = 2048;
+    int batch = 128;
+    float *samples;
+    FftPlan plan;
+    FftComplex *complexSamples;
+    char name[32];
+
+    if (argc > 1) N = atoi(argv[1]);
+
+    if (argc > 2) batch = atoi(argv[2]);
+
+    // cufft.cu: Input Generation
+    generate_fake_samples(N, FFT_PI / 20.0, &samples);
+    real_to_complex(samples, &complexSamples, N);
+    printf("Initial Samples:\n");
+
+    for (i = 0; i < nprints; i++)
+    {
+        printf("  %2.4f\n", samples[i]);
+    }
+
+    printf("  ...\n");
+
+    // Setup the plan and execute a complex-to-complex 1D FFT in place
+    if (fftPlan1d(&plan, N, FFT_C2C, 1) != 0 ||
+            fftExecC2C(&plan, complexSamples, complexSamples, FFT_FORWARD) != 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("Fourier Coefficients:\n");
+
+    for (i = 0; i < nprints; i++)
+    {
+        printf("  %d: (%2.4f, %2.4f)\n", i + 1, complexSamples[i].x,
+               complexSamples[i].y);
+    }
+
+    printf("  ...\n");
+    printf("cufft      N = %d: relative error %.2e against the DFT\n", N,
+           check_dft(samples, complexSamples, N));
+
+    fftDestroy(&plan);
+    free(samples);
+    free(complexSamples);
+
+    // cufft-multi.cu
+    int M = 1024;
+    double maxErr = 0.0;
+
+    generate_fake_samples(M, FFT_PI / 4.0, &samples);
+    real_to_complex(samples, &complexSamples, M);
+    fftPlan1d(&plan, M, FFT_C2C, 1);
+    fftExecC2C(&plan, complexSamples, complexSamples, FFT_FORWARD);
+
+    for (i = 0; i < M; i++)
+    {
+        double re = i == M / 8 || i == M - M / 8 ? M / 2 : 0.0;
+        maxErr = fmax(maxErr, hypot(complexSamples[i].x - re,
+                                    complexSamples[i].y));
+    }
+
+    printf("cufft-multi N = %d: bins %d and %d (%.4f, %.4f), largest error "
+           "%.2e\n", M, M / 8, M - M / 8, complexSamples[M / 8].x,
+           complexSamples[M - M / 8].x, maxErr);
+
+    fftDestroy(&plan);
+    free(samples);
+    free(complexSamples);
+
+    // R2C of batch lines in place, against out of place
+    int H = N / 2 + 1;
+    float *padded = (float *)malloc((size_t)2 * H * batch * sizeof(float));
+    FftComplex *spectra = (FftComplex *)malloc((size_t)H * batch *
+                          sizeof(FftComplex));
+
+    samples = (float *)malloc((size_t)N * batch * sizeof(float));
+
+    if (padded == NULL || spectra == NULL || samples == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (size_t j = 0; j < (size_t)N * batch; j++)
+        samples[j] = (float)rand() / RAND_MAX;
+
+    for (int l = 0; l < batch; l++)
+        memcpy(padded + (size_t)2 * H * l, samples + (size_t)N * l,
+               N * sizeof(float));
+
+    if (fftPlan1d(&plan, N, FFT_R2C, batch) != 0 ||
+            fftExecR2C(&plan, samples, spectra) != 0 ||
+            fftExecR2C(&plan, padded, (FftComplex *)padded) != 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    maxErr = 0.0;
+
+    for (size_t j = 0; j < (size_t)H * batch; j++)
+    {
+        FftComplex z = ((FftComplex *)padded)[j];
+        maxErr = fmax(maxErr, hypot(z.x - spectra[j].x, z.y - spectra[j].y));
+    }
+
+    printf("R2C in place, %d lines: largest difference %.2e\n", batch,
+           maxErr);
+
+    fftDestroy(&plan);
+    free(samples);
+    free(padded);
+    free(spectra);
+
+    if (maxErr != 0.0)
+    {
+        fprintf(stderr, "in place and out of place R2C differ\n");
+        return 1;
+    }
+
+    // batches, all threads and one
+    size_t nelem = (size_t)N * batch;
+    FftComplex *in = (FftComplex *)malloc(nelem * sizeof(FftComplex));
+    FftComplex *out = (FftComplex *)malloc(nelem * sizeof(FftComplex));
+
+    if (in == NULL || out == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (size_t j = 0; j < nelem; j++)
+    {
+        in[j].x = (float)rand() / RAND_MAX;
+        in[j].y = (float)rand() / RAND_MAX;
+    }
+
+    printf("%d lines of %d, %d threads\n", batch, N,
+           (int)sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (int type = FFT_C2C; type <= FFT_R2C; type++)
+    {
+        for (int nthreads = 0; nthreads <= 1; nthreads++)
+        {
+            if (type == FFT_C2C)
+                fftPlanMany(&plan, N, FFT_C2C, batch, 1, N, 1, N, nthreads);
+            else
+                fftPlanMany(&plan, N, FFT_R2C, batch, 1, 2 * N, 1, N,
+                            nthreads);
+
+            double iElaps = time_exec(&plan, in, out);
+
+            snprintf(name, sizeof(name), "%s %s", type == FFT_C2C ? "C2C" :
+                     "R2C", nthreads ? "1 thread" : "threads");
+            report(name, iElaps, N, batch, type == FFT_C2C ? 5.0 : 2.5);
+            fftDestroy(&plan);
+        }
+    }
+
+    free(in);
+    free(out);
+
+    // one long line, passes split over the threads, and on one thread
+    in = (FftComplex *)malloc(LONG * sizeof(FftComplex));
+    out = (FftComplex *)malloc(LONG * sizeof(FftComplex));
+
+    for (i = 0; i < LONG; i++)
+    {
+        in[i].x = (float)rand() / RAND_MAX;
+        in[i].y = (float)rand() / RAND_MAX;
+    }
+
+    for (int nthreads = 0; nthreads <= 1; nthreads++)
+    {
+        fftPlanMany(&plan, LONG, FFT_C2C, 1, 1, LONG, 1, LONG, nthreads);
+
+        double iElaps = time_exec(&plan, in, out);
+
+        snprintf(name, sizeof(name), "C2C %d %s", LONG, nthreads ?
+                 "1 thread" : "split");
+        report(name, iElaps, LONG, 1, 5.0);
+        fftDestroy(&plan);
+    }
+
+    free(in);
+    free(out);
+    fftCacheFree();
+
+    return 0;
+}
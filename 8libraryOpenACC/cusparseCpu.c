@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "../common/sparse.h"
+
+extern int sgemm_(char *transa, char *transb, int *m, int *
+                  n, int *k, float *alpha, float *a, int *lda, float *b, int *
+                  ldb, float *beta, float *c, int *ldc);
+
+/*
+ * The pipeline of cusparse.cu on the host, with the engine in
+ * common/sparse.h: count the non-zeros of a random column-major dense
+ * matrix, convert it to CSR, and compute y = alpha * A * x + beta * y.
+ *
+ * The product is timed in each of CSR, SELL-C-sigma and BCSR and in the
+ * format sparseMatrixCreate picks, and against the dense path, sgemm_ with
+ * one column, on the host BLAS of blas-cpu.c. Rates are GFLOP/s of useful
+ * work, 2 * nnz for the sparse formats and 2 * M * N for sgemm_. Every
+ * result is checked against a double-precision loop over the CSR matrix,
+ * and any mismatch makes the exit status non-zero.
+ *
+ * pattern 0 is the matrix of cusparse.cu, two thirds zeros; 1 has a few
+ * long rows and many short ones; 2 is made of dense 4 x 4 blocks; 3 has
+ * rows of 4 to 12 non-zeros.
+ */
+
+// products per timing
+#define NREP 100
+
+/*
+ * M = # of rows
+ * N = # of columns
+ */
+int M = 1024;
+int N = 1024;
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+/*
+ * Generate a vector of length N with random single-precision floating-point
+ * values between 0 and 100.
+ */
+void generate_random_vector(int N, float **outX)
+{
+    int i;
+    double rMax = (double)RAND_MAX;
+    float *X = (float *)malloc(sizeof(float) * N);
+
+    for (i = 0; i < N; i++)
+    {
+        int r = rand();
+        double dr = (double)r;
+        X[i] = (dr / rMax) * 100.0;
+    }
+
+    *outX = X;
+}
+
+/*
+ * Generate random dense matrix A in column-major order, while rounding some
+ * elements down to zero to ensure it is sparse.
+ */
+int generate_random_dense_matrix(int M, int N, float **outA)
+{
+    int i, j;
+    double rMax = (double)RAND_MAX;
+    float *A = (float *)malloc(sizeof(float) * M * N);
+    int totalNnz = 0;
+
+    for (j = 0; j < N; j++)
+    {
+        for (i = 0; i < M; i++)
+        {
+            int r = rand();
+            float *curr = A + (j * M + i);
+
+            if (r % 3 > 0)
+            {
+                *curr = 0.0f;
+            }
+            else
+            {
+                double dr = (double)r;
+                *curr = (dr / rMax) * 100.0;
+            }
+
+            if (*curr != 0.0f)
+            {
+                totalNnz++;
+            }
+        }
+    }
+
+    *outA = A;
+    return totalNnz;
+}
+
+/*
+ * Row i keeps an element with probability p_i: with skewed, drawn from a
+ * power law, so that most rows hold a handful of non-zeros and a few hold
+ * hundreds; otherwise between 4 / N and 12 / N.
+ */
+int generate_skewed_dense_matrix(int M, int N, int skewed, float **outA)
+{
+    double rMax = (double)RAND_MAX;
+    float *A = (float *)calloc((size_t)M * N, sizeof(float));
+    double *p = (double *)malloc(M * sizeof(double));
+    int totalNnz = 0;
+
+    for (int i = 0; i < M; i++)
+    {
+        double u = (rand() + 1.0) / (rMax + 1.0);
+        p[i] = skewed ? 1.0 / N * pow(u, -1.5) : 8.0 / N * (0.5 + u);
+
+        if (p[i] > 1.0) p[i] = 1.0;
+    }
+
+    for (int j = 0; j < N; j++)
+    {
+        for (int i = 0; i < M; i++)
+        {
+            if (rand() / rMax < p[i])
+            {
+                A[(size_t)j * M + i] = (rand() / rMax) * 100.0 + 1.0;
+                totalNnz++;
+            }
+        }
+    }
+
+    free(p);
+    *outA = A;
+    return totalNnz;
+}
+
+// dense 4 x 4 blocks, one in twenty kept
+int generate_blocked_dense_matrix(int M, int N, float **outA)
+{
+    double rMax = (double)RAND_MAX;
+    float *A = (float *)calloc((size_t)M * N, sizeof(float));
+    int totalNnz = 0;
+
+    for (int bj = 0; bj < N; bj += 4)
+    {
+        for (int bi = 0; bi < M; bi += 4)
+        {
+            if (rand() % 20 != 0) continue;
+
+            for (int j = bj; j < bj + 4 && j < N; j++)
+            {
+                for (int i = bi; i < bi + 4 && i < M; i++)
+                {
+                    A[(size_t)j * M + i] = (rand() / rMax) * 100.0 + 1.0;
+                    totalNnz++;
+                }
+            }
+        }
+    }
+
+    *outA = A;
+    return totalNnz;
+}
+
+// alpha * A * x + beta * y0 in double, from the CSR form
+void reference_mv(const SparseCsr *a, float alpha, const float *x, float beta,
+                  const float *y0, double *ref)
+{
+    for (int i = 0; i < a->m; i++)
+    {
+        double sum = 0.0;
+
+        for (int k = a->rowPtr[i]; k < a->rowPtr[i + 1]; k++)
+            sum += (double)a->val[k] * x[a->colInd[k]];
+
+        ref[i] = alpha * sum + (double)beta * y0[i];
+    }
+}
+
+int check(const char *name, const float *Y, const double *ref, int M)
+{
+    for (int i = 0; i < M; i++)
+    {
+        if (fabs(Y[i] - ref[i]) > 1e-4 * (fabs(ref[i]) + 1.0))
+        {
+            printf("%s: different on row %d: %f expected %f\n", name, i, Y[i],
+                   ref[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int row;
+    float *A;
+    SparseCsr csr;
+    SparseMatrix mat;
+    int pattern = 0;
+    int trueNnz;
+    float alpha = 3.0f;
+    float beta = 4.0f;
+    float *X, *Y, *Y0;
+    int one = 1;
+    int err = 0;
+
+    if (argc > 1) M = atoi(argv[1]);
+
+    if (argc > 2) N = atoi(argv[2]);
+
+    if (argc > 3) pattern = atoi(argv[3]);
+
+    // Generate input
+    srand(9384);
+
+    if (pattern == 1 || pattern == 3)
+        trueNnz = generate_skewed_dense_matrix(M, N, pattern == 1, &A);
+    else if (pattern == 2)
+        trueNnz = generate_blocked_dense_matrix(M, N, &A);
+    else
+        trueNnz = generate_random_dense_matrix(M, N, &A);
+
+    generate_random_vector(N, &X);
+    generate_random_vector(M, &Y0);
+    Y = (float *)malloc(sizeof(float) * M);
+    double *ref = (double *)malloc(sizeof(double) * M);
+
+    printf("%s M = %d N = %d pattern %d\n", argv[0], M, N, pattern);
+
+    // Convert A from a dense formatting to a CSR formatting
+    double iStart = seconds();
+
+    if (sparseDense2Csr(M, N, A, M, &csr) != 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    double iElaps = seconds() - iStart;
+
+    if (csr.nnz != trueNnz)
+    {
+        fprintf(stderr, "Difference detected between NNZ and true value: "
+                "expected %d but got %d\n", trueNnz, csr.nnz);
+        return 1;
+    }
+
+    printf("dense2csr      %8.3f ms  nnz %d (%.2f%%) %.2f GB/s read\n",
+           iElaps * 1e3, csr.nnz, 100.0 * csr.nnz / ((double)M * N),
+           2.0 * M * N * sizeof(float) / 1e9 / iElaps);
+
+    reference_mv(&csr, alpha, X, beta, Y0, ref);
+
+    // each format, then the choice
+    for (int format = SPARSE_CSR; format <= SPARSE_BCSR + 1; format++)
+    {
+        int choose = format > SPARSE_BCSR;
+
+        iStart = seconds();
+
+        if (sparseMatrixCreate(&mat, &csr, choose ? -1 : format) != 0)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        double tBuild = seconds() - iStart;
+
+        if (choose)
+        {
+            printf("rows: mean %.1f max %d; SELL fill %.2f BCSR fill %.2f "
+                   "-> %s\n", mat.meanRow, mat.maxRow, mat.sellFill,
+                   mat.bcsrFill, sparseFormatName(mat.format));
+        }
+
+        memcpy(Y, Y0, sizeof(float) * M);
+        sparseMv(&mat, alpha, X, beta, Y);
+        err |= check(sparseFormatName(mat.format), Y, ref, M);
+
+        iStart = seconds();
+
+        for (int k = 0; k < NREP; k++)
+        {
+            memcpy(Y, Y0, sizeof(float) * M);
+            sparseMv(&mat, alpha, X, beta, Y);
+        }
+
+        iElaps = (seconds() - iStart) / NREP;
+        printf("%-14s %8.3f ms  %7.2f GFLOP/s  (build %.3f ms)\n", choose ?
+               "auto" : sparseFormatName(format), iElaps * 1e3,
+               2.0 * csr.nnz / 1e9 / iElaps, tBuild * 1e3);
+        sparseMatrixFree(&mat);
+    }
+
+    // the dense path
+    memcpy(Y, Y0, sizeof(float) * M);
+    sgemm_("N", "N", &M, &one, &N, &alpha, A, &M, X, &N, &beta, Y, &M);
+    err |= check("sgemm_", Y, ref, M);
+
+    iStart = seconds();
+
+    for (int k = 0; k < NREP; k++)
+    {
+        memcpy(Y, Y0, sizeof(float) * M);
+        sgemm_("N", "N", &M, &one, &N, &alpha, A, &M, X, &N, &beta, Y, &M);
+    }
+
+    iElaps = (seconds() - iStart) / NREP;
+    printf("%-14s %8.3f ms  %7.2f GFLOP/s  (%.2f GFLOP/s useful)\n",
+           "dense sgemm_", iElaps * 1e3, 2.0 * M * N / 1e9 / iElaps,
+           2.0 * csr.nnz / 1e9 / iElaps);
+
+    for (row = 0; row < 10; row++)
+    {
+        printf("%2.2f\n", Y[row]);
+    }
+
+    printf("...\n");
+
+    free(A);
+    free(X);
+    free(Y);
+    free(Y0);
+    free(ref);
+    sparseCsrFree(&csr);
+
+    return err;
+}
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "../common/gemm.h"
+
+extern int sgemm_(char *transa, char *transb, int *m, int *
+                  n, int *k, float *alpha, float *a, int *lda, float *b, int *
+                  ldb, float *beta, float *c, int *ldc);
+extern int dgemm_(char *transa, char *transb, int *m, int *
+                  n, int *k, double *alpha, double *a, int *lda, double *b,
+                  int *ldb, double *beta, double *c, int *ldc);
+
+/*
+ * The call of drop-in.c, sgemm_ on M x M column-major matrices, timed on
+ * the host BLAS of blas-cpu.c against the triple loop a reference BLAS
+ * runs. Every transpose combination of sgemm_ and dgemm_ is timed on all
+ * threads and on one (gemmS and gemmD with nthreads = 1), together with
+ * the single-column product of cusparseCpu.c, and checked against the
+ * loop computed in double precision.
+ */
+
+// timed calls of every version
+#define NREP 3
+
+int M = 1024;
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+void generate_random_dense_matrix(int M, int N, float **outA)
+{
+    double rMax = (double)RAND_MAX;
+    float *A = (float *)malloc(sizeof(float) * M * N);
+
+    for (int i = 0; i < M * N; i++)
+    {
+        double dr = (double)rand();
+        A[i] = (dr / rMax) * 100.0;
+    }
+
+    *outA = A;
+}
+
+/*
+ * The loop order of the reference sgemm for op(A) = A: for each column j
+ * of C, C(:, j) += alpha * A(:, p) * op(B)(p, j) over p.
+ */
+void reference_gemm(char ta, char tb, int m, int n, int k, double alpha,
+                    const float *A, int lda, const float *B, int ldb,
+                    double beta, const float *C0, double *C, int ldc)
+{
+    for (int j = 0; j < n; j++)
+    {
+        double *cj = C + (size_t)j * ldc;
+
+        for (int i = 0; i < m; i++) cj[i] = beta * C0[(size_t)j * ldc + i];
+
+        for (int p = 0; p < k; p++)
+        {
+            double bpj = alpha * (tb == 'N' ? B[p + (size_t)j * ldb] :
+                                  B[j + (size_t)p * ldb]);
+
+            for (int i = 0; i < m; i++)
+                cj[i] += bpj * (ta == 'N' ? A[i + (size_t)p * lda] :
+                                A[p + (size_t)i * lda]);
+        }
+    }
+}
+
+// the triple loop in float, as the reference BLAS runs it
+void naive_sgemm(int m, int n, int k, float alpha, const float *A, int lda,
+                 const float *B, int ldb, float beta, float *C, int ldc)
+{
+    for (int j = 0; j < n; j++)
+    {
+        float *cj = C + (size_t)j * ldc;
+
+        for (int i = 0; i < m; i++) cj[i] *= beta;
+
+        for (int p = 0; p < k; p++)
+        {
+            float bpj = alpha * B[p + (size_t)j * ldb];
+
+            for (int i = 0; i < m; i++) cj[i] += bpj * A[i + (size_t)p * lda];
+        }
+    }
+}
+
+int check(const char *name, const float *C, const double *ref, int n)
+{
+    double maxRef = 0.0;
+
+    for (int i = 0; i < n; i++)
+        if (fabs(ref[i]) > maxRef) maxRef = fabs(ref[i]);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (fabs(C[i] - ref[i]) > 1e-5 * maxRef)
+        {
+            printf("%s: different on element %d: %f expected %f\n", name, i,
+                   C[i], ref[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int checkd(const char *name, const double *C, const double *ref, int n)
+{
+    double maxRef = 0.0;
+
+    for (int i = 0; i < n; i++)
+        if (fabs(ref[i]) > maxRef) maxRef = fabs(ref[i]);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (fabs(C[i] - ref[i]) > 1e-12 * maxRef)
+        {
+            printf("%s: different on element %d: %f expected %f\n", name, i,
+                   C[i], ref[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void report(const char *name, double iElaps, int m, int n, int k)
+{
+    printf("%-16s %9.3f ms %8.2f GFLOP/s\n", name, iElaps * 1e3,
+           2.0 * m * n * k / 1e9 / iElaps);
+}
+
+int main(int argc, char **argv)
+{
+    float *A, *B, *C0;
+    float alpha = 3.0f;
+    float beta = 4.0f;
+    double dalpha = 3.0, dbeta = 4.0;
+    int one = 1;
+    const char *trans[4] = { "NN", "TN", "NT", "TT" };
+    char name[32];
+
+    if (argc > 1) M = atoi(argv[1]);
+
+    printf("%s M = %d threads %d\n", argv[0], M,
+           (int)sysconf(_SC_NPROCESSORS_ONLN));
+
+    size_t nelem = (size_t)M * M;
+
+    srand(9384);
+    generate_random_dense_matrix(M, M, &A);
+    generate_random_dense_matrix(M, M, &B);
+    generate_random_dense_matrix(M, M, &C0);
+
+    float *C = (float *)malloc(nelem * sizeof(float));
+    double *ref = (double *)malloc(nelem * sizeof(double));
+    double *dA = (double *)malloc(nelem * sizeof(double));
+    double *dB = (double *)malloc(nelem * sizeof(double));
+    double *dC = (double *)malloc(nelem * sizeof(double));
+
+    for (size_t i = 0; i < nelem; i++)
+    {
+        dA[i] = A[i];
+        dB[i] = B[i];
+    }
+
+    // the reference BLAS loop
+    memcpy(C, C0, nelem * sizeof(float));
+    double iStart = seconds();
+    naive_sgemm(M, M, M, alpha, A, M, B, M, beta, C, M);
+    report("loop sgemm", seconds() - iStart, M, M, M);
+
+    for (int t = 0; t < 4; t++)
+    {
+        char ta = trans[t][0], tb = trans[t][1];
+
+        reference_gemm(ta, tb, M, M, M, alpha, A, M, B, M, beta, C0, ref, M);
+
+        // all threads, through the Fortran interface
+        memcpy(C, C0, nelem * sizeof(float));
+        sgemm_(&ta, &tb, &M, &M, &M, &alpha, A, &M, B, &M, &beta, C, &M);
+        snprintf(name, sizeof(name), "sgemm_ %s", trans[t]);
+        check(name, C, ref, (int)nelem);
+
+        iStart = seconds();
+
+        for (int r = 0; r < NREP; r++)
+            sgemm_(&ta, &tb, &M, &M, &M, &alpha, A, &M, B, &M, &beta, C, &M);
+
+        report(name, (seconds() - iStart) / NREP, M, M, M);
+
+        // one thread
+        memcpy(C, C0, nelem * sizeof(float));
+        gemmS(ta, tb, M, M, M, alpha, A, M, B, M, beta, C, M, 1);
+        snprintf(name, sizeof(name), "sgemm %s 1 thr", trans[t]);
+        check(name, C, ref, (int)nelem);
+
+        iStart = seconds();
+
+        for (int r = 0; r < NREP; r++)
+            gemmS(ta, tb, M, M, M, alpha, A, M, B, M, beta, C, M, 1);
+
+        report(name, (seconds() - iStart) / NREP, M, M, M);
+
+        // double
+        for (size_t i = 0; i < nelem; i++) dC[i] = C0[i];
+
+        dgemm_(&ta, &tb, &M, &M, &M, &dalpha, dA, &M, dB, &M, &dbeta, dC, &M);
+        snprintf(name, sizeof(name), "dgemm_ %s", trans[t]);
+        checkd(name, dC, ref, (int)nelem);
+
+        iStart = seconds();
+
+        for (int r = 0; r < NREP; r++)
+            dgemm_(&ta, &tb, &M, &M, &M, &dalpha, dA, &M, dB, &M, &dbeta, dC,
+                   &M);
+
+        report(name, (seconds() - iStart) / NREP, M, M, M);
+    }
+
+    // one column: the dense path of cusparseCpu.c
+    reference_gemm('N', 'N', M, 1, M, alpha, A, M, B, M, beta, C0, ref, M);
+    memcpy(C, C0, M * sizeof(float));
+    sgemm_("N", "N", &M, &one, &M, &alpha, A, &M, B, &M, &beta, C, &M);
+    check("sgemm_ n = 1", C, ref, M);
+
+    iStart = seconds();
+
+    for (int r = 0; r < 100; r++)
+        sgemm_("N", "N", &M, &one, &M, &alpha, A, &M, B, &M, &beta, C, &M);
+
+    report("sgemm_ n = 1", (seconds() - iStart) / 100, M, 1, M);
+
+    free(A);
+    free(B);
+    free(C0);
+    free(C);
+    free(ref);
+    free(dA);
+    free(dB);
+    free(dC);
+
+    return 0;
+}
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "../common/rng.h"
+
+/*
+ * replace-rand.cu and replace-rand-streams.cu on the host, with the service
+ * in common/rng.h: rand() is replaced by values pre-generated in bulk and
+ * handed out one per call, refilled in place (replace-rand.cu) or on a
+ * helper thread while the last batch is consumed (replace-rand-streams.cu).
+ *
+ * The sample times, in ns per value, host_rand() against rngRand() on one
+ * thread and on nthreads, where every rand() call goes through the lock
+ * glibc keeps around its state and rngRand through the thread's own
+ * service; then a service refilled in place and one refilled in the
+ * background, and the bulk rates of rngUniform and rngNormal. The mean and
+ * variance of every stream are printed as a check.
+ *
+ * First the generator is checked against the Philox4x32-10 known answers
+ * of Random123, block by block and through rngUniform; the sample exits
+ * with 1 if any word differs.
+ */
+
+/*
+ * N = # of values drawn per test
+ * nthreads = # of threads drawing at once
+ */
+int N = 8388608;
+int nthreads = 4;
+
+/*
+ * Philox4x32-10 known answers (Random123 kat_vectors): counter, key and
+ * the four words out.
+ */
+static const uint32_t kat[3][10] =
+{
+    {
+        0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+        0x00000000, 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8
+    },
+    {
+        0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+        0xffffffff, 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd
+    },
+    {
+        0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822,
+        0x299f31d0, 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1
+    }
+};
+
+typedef struct
+{
+    float (*fn)(void);
+    int n;
+    double sum, sum2;
+} Draw;
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+float host_rand()
+{
+    return (float)rand() / (float)RAND_MAX;
+}
+
+float cpu_rand()
+{
+    return rngRand();
+}
+
+void *draw(void *arg)
+{
+    Draw *d = (Draw *)arg;
+    double sum = 0.0, sum2 = 0.0;
+
+    for (int i = 0; i < d->n; i++)
+    {
+        double r = d->fn();
+        sum += r;
+        sum2 += r * r;
+    }
+
+    d->sum = sum;
+    d->sum2 = sum2;
+
+    return NULL;
+}
+
+void report(const char *name, double iElaps, double sum, double sum2, int n)
+{
+    double mean = sum / n;
+
+    printf("%-24s %7.2f ns/value  mean %.4f var %.4f\n", name,
+           iElaps * 1e9 / n, mean, sum2 / n - mean * mean);
+}
+
+// nt threads each drawing N / nt values from fn
+void run(const char *name, float (*fn)(void), int nt)
+{
+    pthread_t *tid = (pthread_t *)malloc(nt * sizeof(pthread_t));
+    Draw *d = (Draw *)malloc(nt * sizeof(Draw));
+    double sum = 0.0, sum2 = 0.0;
+
+    double iStart = seconds();
+
+    for (int t = 0; t < nt; t++)
+    {
+        d[t].fn = fn;
+        d[t].n = N / nt;
+        pthread_create(tid + t, NULL, draw, d + t);
+    }
+
+    for (int t = 0; t < nt; t++)
+    {
+        pthread_join(tid[t], NULL);
+        sum += d[t].sum;
+        sum2 += d[t].sum2;
+    }
+
+    double iElaps = seconds() - iStart;
+
+    report(name, iElaps, sum, sum2, N / nt * nt);
+    free(tid);
+    free(d);
+}
+
+void run_service(const char *name, int background)
+{
+    RngService s;
+    double sum = 0.0, sum2 = 0.0;
+
+    if (rngServiceInit(&s, RNG_SEED, 1000, 1000000, 0, background) != 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    double iStart = seconds();
+
+    for (int i = 0; i < N; i++)
+    {
+        double r = rngNext(&s);
+        sum += r;
+        sum2 += r * r;
+    }
+
+    report(name, seconds() - iStart, sum, sum2, N);
+    rngServiceFree(&s);
+}
+
+// N values in buffers of RNG_BUFFER, as a service refills them
+void run_bulk(const char *name, int normal, float *buf)
+{
+    RngPhilox g;
+    double sum = 0.0, sum2 = 0.0;
+    int nfill = (N + RNG_BUFFER - 1) / RNG_BUFFER;
+
+    rngInit(&g, RNG_SEED, 2000);
+
+    double iStart = seconds();
+
+    for (int i = 0; i < nfill; i++)
+    {
+        if (normal)
+            rngNormal(&g, buf, RNG_BUFFER);
+        else
+            rngUniform(&g, buf, RNG_BUFFER);
+    }
+
+    double iElaps = seconds() - iStart;
+
+    for (int i = 0; i < RNG_BUFFER; i++)
+    {
+        sum += buf[i];
+        sum2 += (double)buf[i] * buf[i];
+    }
+
+    report(name, iElaps / nfill, sum, sum2, RNG_BUFFER);
+}
+
+/*
+ * rngBlock against the known answers; then, for the counters that start a
+ * group, the first block of rngUniform, which takes the AVX2 path when
+ * there is one, against the same words.
+ */
+int check_philox()
+{
+    int err = 0;
+
+    for (int t = 0; t < 3; t++)
+    {
+        uint32_t c[4] = { kat[t][0], kat[t][1], kat[t][2], kat[t][3] };
+        uint32_t key[2] = { kat[t][4], kat[t][5] };
+        uint64_t counter = kat[t][0] | (uint64_t)kat[t][1] << 32;
+
+        rngBlock(c, key);
+
+        for (int k = 0; k < 4; k++)
+        {
+            if (c[k] != kat[t][6 + k])
+            {
+                printf("Philox4x32-10 vector %d word %d: %08x expected "
+                       "%08x\n", t, k, c[k], kat[t][6 + k]);
+                err = 1;
+            }
+        }
+
+        if (counter % 8 != 0) continue;
+
+        RngPhilox g;
+        float u[2 * RNG_GROUP];
+
+        rngInit(&g, key[0] | (uint64_t)key[1] << 32,
+                kat[t][2] | (uint64_t)kat[t][3] << 32);
+        g.counter = counter;
+        rngUniform(&g, u, 2 * RNG_GROUP);
+
+        // value j of a group is word j / 8 of block j % 8
+        for (int k = 0; k < 4; k++)
+        {
+            if (u[8 * k] != rngToUniform(kat[t][6 + k]))
+            {
+                printf("rngUniform vector %d word %d: %f expected %f\n", t,
+                       k, u[8 * k], rngToUniform(kat[t][6 + k]));
+                err = 1;
+            }
+        }
+    }
+
+    if (!err) printf("Philox4x32-10 known answers match\n");
+
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    char name[32];
+
+    if (argc > 1) N = atoi(argv[1]);
+
+    if (argc > 2) nthreads = atoi(argv[2]);
+
+    printf("%s N = %d nthreads = %d\n", argv[0], N, nthreads);
+
+    if (check_philox() != 0) return 1;
+
+    srand(9384);
+    run("host_rand", host_rand, 1);
+    run("cpu_rand", cpu_rand, 1);
+
+    snprintf(name, sizeof(name), "host_rand %d threads", nthreads);
+    run(name, host_rand, nthreads);
+    snprintf(name, sizeof(name), "cpu_rand %d threads", nthreads);
+    run(name, cpu_rand, nthreads);
+
+    run_service("service, in place", 0);
+    run_service("service, background", 1);
+
+    float *buf = (float *)malloc(RNG_BUFFER * sizeof(float));
+
+    if (buf == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    run_bulk("rngUniform", 0, buf);
+    run_bulk("rngNormal", 1, buf);
+
+    for (int i = 0; i < 10; i++)
+    {
+        printf("%2.4f %2.4f\n", host_rand(), cpu_rand());
+    }
+
+    free(buf);
+
+    return 0;
+}
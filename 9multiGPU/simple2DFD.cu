@@ -1,4 +1,5 @@
 #include "../common/common.h"
+#include "../common/snapshot.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -13,6 +14,11 @@
  * single host application. Here, kernels and transfers are issued in
  * breadth-first order to each CUDA stream. Each CUDA stream is associated with
  * a single CUDA device.
+ *
+ * Snapshots are copied into pinned staging buffers on a separate stream while
+ * the next step runs, then compressed and written by the background writer in
+ * common/snapshot.h, so the time loop only waits on disk when all staging
+ * buffers are still in flight.
  */
 
 #define a0     -3.0124472f
@@ -36,14 +42,34 @@ void setup_coef (void)
     CHECK( cudaMemcpyToSymbol( coef, h_coef, 5 * sizeof(float) ));
 }
 
-void saveSnapshotIstep(
+// pinned, portable staging buffers so any device can copy into them async
+void *pinnedAlloc(size_t size)
+{
+    void *p;
+    CHECK(cudaHostAlloc(&p, size, cudaHostAllocPortable));
+    return p;
+}
+
+void pinnedFree(void *p)
+{
+    CHECK(cudaFreeHost(p));
+}
+
+/*
+ * Start copying the wavefield into a staging buffer on stream_snap. g_u2 is
+ * only read during the next step, so the copy overlaps it; the buffer is
+ * handed to the writer once the devices have synchronized.
+ */
+float *saveSnapshotIstep(
+    SnapWriter *snap,
     int istep,
     int nx,
     int ny,
     int ngpus,
-    float **g_u2)
+    float **g_u2,
+    cudaStream_t *stream_snap)
 {
-    float *iwave = (float *)malloc(nx * ny * sizeof(float));
+    float *iwave = snapAcquire(snap);
 
     if (ngpus > 1)
     {
@@ -55,29 +81,22 @@ void saveSnapshotIstep(
             CHECK(cudaSetDevice(i));
             int iskip = (i == 0 ? 0 : skiptop);
             int ioff  = (i == 0 ? 0 : gsize);
-            CHECK(cudaMemcpy(iwave + ioff, g_u2[i] + iskip,
-                        gsize * sizeof(float), cudaMemcpyDeviceToHost));
+            CHECK(cudaMemcpyAsync(iwave + ioff, g_u2[i] + iskip,
+                        gsize * sizeof(float), cudaMemcpyDeviceToHost,
+                        stream_snap[i]));
         }
     }
     else
     {
         unsigned int isize = nx * ny;
-        CHECK(cudaMemcpy (iwave, g_u2[0], isize * sizeof(float),
-                          cudaMemcpyDeviceToHost));
+        CHECK(cudaSetDevice(0));
+        CHECK(cudaMemcpyAsync(iwave, g_u2[0], isize * sizeof(float),
+                              cudaMemcpyDeviceToHost, stream_snap[0]));
     }
 
-    char fname[20];
-    sprintf(fname, "snap_at_step_%d", istep);
-
-    FILE *fp_snap = fopen(fname, "w");
-
-    fwrite(iwave, sizeof(float), nx * ny, fp_snap);
-    printf("%s: nx = %d ny = %d istep = %d\n", fname, nx, ny, istep);
+    printf("snapshot: nx = %d ny = %d istep = %d\n", nx, ny, istep);
     fflush(stdout);
-    fclose(fp_snap);
-
-    free(iwave);
-    return;
+    return iwave;
 }
 
 inline bool isCapableP2P(int ngpus)
@@ -377,6 +396,19 @@ int main( int argc, char *argv[] )
 
     if(argc >= 3) iMovie = atoi(argv[2]);
 
+    // snapshot period, compression mode and error bound for SNAP_BOUNDED
+    int iSnap = 10000;
+    int mode  = SNAP_LOSSLESS;
+    float tol = 1.0e-5f;
+
+    if(argc >= 4) iSnap = atoi(argv[3]);
+
+    if(argc >= 5) mode = atoi(argv[4]);
+
+    if(argc >= 6) tol = (float)atof(argv[5]);
+
+    if(iSnap < 1) iSnap = 10000;
+
     printf("> run with device: %i\n", ngpus);
 
     // size
@@ -410,13 +442,24 @@ int main( int argc, char *argv[] )
     }
 
     // stream definition
-    cudaStream_t stream_halo[ngpus], stream_body[ngpus];
+    cudaStream_t stream_halo[ngpus], stream_body[ngpus], stream_snap[ngpus];
 
     for (int i = 0; i < ngpus; i++)
     {
         CHECK(cudaSetDevice(i));
         CHECK(cudaStreamCreate( &stream_halo[i] ));
         CHECK(cudaStreamCreate( &stream_body[i] ));
+        CHECK(cudaStreamCreate( &stream_snap[i] ));
+    }
+
+    // three pinned staging buffers feeding the snapshot writer thread
+    SnapWriter snap;
+
+    if (snapOpen(&snap, "snapshots.snap", 3, (size_t)nx * ny, mode, tol,
+                 pinnedAlloc, pinnedFree) != 0)
+    {
+        fprintf(stderr, "cannot open snapshots.snap\n");
+        exit(1);
     }
 
     // calculate index for computation
@@ -441,8 +484,12 @@ int main( int argc, char *argv[] )
     // main loop for wave propagation
     for(int istep = 0; istep < nsteps; istep++)
     {
-        // save snap image
-        if(iMovie == istep) saveSnapshotIstep(istep, nx, ny, ngpus, d_u2);
+        // start copying the snap image out
+        float *iwave = NULL;
+
+        if(istep >= iMovie && (istep - iMovie) % iSnap == 0)
+            iwave = saveSnapshotIstep(&snap, istep, nx, ny, ngpus, d_u2,
+                                      stream_snap);
 
         // add wavelet only onto gpu0
         if (istep == 0)
@@ -483,6 +530,11 @@ int main( int argc, char *argv[] )
             d_u1[i] = d_u2[i];
             d_u2[i] = tmpu0;
         }
+
+        // the copy is done; compress and write it in the background
+        if (iwave != NULL && snapSubmit(&snap, iwave, istep, nx, ny) != 0)
+            fprintf(stderr, "snapshot %d does not fit the staging buffers\n",
+                    istep);
     }
 
     CHECK(cudaSetDevice( 0 ));
@@ -503,6 +555,9 @@ int main( int argc, char *argv[] )
     CHECK(cudaEventDestroy(start));
     CHECK(cudaEventDestroy(stop));
 
+    if (snapClose(&snap) != 0)
+        fprintf(stderr, "error writing snapshots.snap\n");
+
     // clear
     for (int i = 0; i < ngpus; i++)
     {
@@ -510,6 +565,7 @@ int main( int argc, char *argv[] )
 
         CHECK (cudaStreamDestroy( stream_halo[i] ));
         CHECK (cudaStreamDestroy( stream_body[i] ));
+        CHECK (cudaStreamDestroy( stream_snap[i] ));
 
         CHECK (cudaFree (d_u1[i]));
         CHECK (cudaFree (d_u2[i]));
@@ -0,0 +1,493 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "../common/hostmem.h"
+#include "../common/snapshot.h"
+#include "../common/stencil.h"
+
+/*
+ * This example runs the 2D stencil of simple2DFD.cu on the host. The grid is
+ * split along y into one domain per thread, as simple2DFD splits it across
+ * GPUs, and every domain keeps ghost rows copied from its neighbours.
+ *
+ * Three things make it fast on a CPU:
+ *
+ *  - the x loop runs in AVX (or SSE) registers, 8 (or 4) points at a time,
+ *    in stencilWave2d from common/stencil.h;
+ *  - up to TB time steps are fused into one sweep down the domain (temporal
+ *    blocking). Step s of the sweep trails step s-1 by NPAD rows, so a row
+ *    is read for all TB steps while it is still in cache. The ghost zones are
+ *    TB * NPAD rows deep, and the rows near each edge are recomputed
+ *    redundantly, so neighbours exchange halos once per TB steps instead of
+ *    every step;
+ *  - like the stream_halo/stream_body split, a domain posts its top halo to
+ *    its neighbour as soon as the sweep has finished those rows. It keeps
+ *    going with the body while the neighbour picks the rows up. Halos go
+ *    through double-buffered mailboxes, so a domain waits only for its own
+ *    two neighbours and never on a global barrier.
+ *
+ * Each point gets the same floating-point operations in the same order as
+ * kernel_2dfd. A serial run of that arithmetic checks the result. Snapshots
+ * go through the background writer in common/snapshot.h into one container
+ * file, like simple2DFD. The wavefields and the staging buffers come from
+ * the pooled, aligned allocator in common/hostmem.h. With one or two
+ * domains the wavelet sits where simple2DFD puts it for one or two GPUs.
+ */
+
+#define a0     -3.0124472f
+#define a1      1.7383092f
+#define a2     -0.2796695f
+#define a3      0.0547837f
+#define a4     -0.0073118f
+
+#define NPAD        4
+#define NPAD2       8
+
+// maximum number of time steps fused into one sweep
+#define MAXTB       16
+
+// halo rows sent to one neighbour, both time levels, for one block
+typedef struct
+{
+    float *buf[2];          // one per block parity
+    int seq;                // last block posted
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+} Mailbox;
+
+typedef struct
+{
+    int id;
+    int y0, y1;             // owned global rows [y0, y1)
+    int ylo;                // global row of local row 0 (y0 - ghost depth)
+    int nrows;              // stored rows
+    float *u1, *u2;         // previous and current time levels
+    int block;              // blocks completed
+    Mailbox up, down;       // halos posted to domains id - 1 and id + 1
+} Domain;
+
+static int nx, ny, ndom, tb, ghost;
+static Domain *dom;
+
+// steps for the solver threads to run: [seg_start, seg_stop)
+static int seg_start, seg_stop;
+
+static double seconds(void)
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+static void initialData(float *ip, int size)
+{
+    memset(ip, 0, size * sizeof(float));
+}
+
+// the coefficients of kernel_2dfd, for the stencils in common/stencil.h
+static const float coef[NPAD + 1] = {a0, a1, a2, a3, a4};
+
+// reference: one step of kernel_2dfd over the whole grid, one point at a time
+static void fd_step_host(float *u1, const float *u2)
+{
+    const float alpha = 0.12f;
+
+    for (int iy = NPAD; iy < ny - NPAD; iy++)
+    {
+        for (int ix = NPAD; ix < nx - NPAD; ix++)
+        {
+            const float *p = u2 + iy * nx + ix;
+            float tmp = a0 * p[0] * 2.0f;
+
+            for (int d = 1; d <= 4; d++)
+            {
+                tmp += (d == 1 ? a1 : d == 2 ? a2 : d == 3 ? a3 : a4) *
+                       (p[-d] + p[d]);
+            }
+
+            for (int d = 1; d <= 4; d++)
+            {
+                tmp += (d == 1 ? a1 : d == 2 ? a2 : d == 3 ? a3 : a4) *
+                       (p[-d * nx] + p[d * nx]);
+            }
+
+            u1[iy * nx + ix] = p[0] + p[0] - u1[iy * nx + ix] + alpha * tmp;
+        }
+    }
+}
+
+// global row of the source, where kernel_add_wavelet puts it on GPU 0
+static int waveletRow(void)
+{
+    const int iny = ny / ndom + NPAD * (ndom - 1);
+    return (ndom == 2 ? iny - 10 : ny / 2 - 10);
+}
+
+static void addWavelet(float wavelets)
+{
+    const int gy = waveletRow();
+
+    for (int i = 0; i < ndom; i++)
+    {
+        Domain *d = &dom[i];
+
+        if (gy >= d->ylo && gy < d->ylo + d->nrows)
+            d->u2[(gy - d->ylo) * nx + nx / 2] += wavelets;
+    }
+}
+
+/*
+ * Halo exchange. Rows [y0, y0 + ghost) of both time levels go up, rows
+ * [y1 - ghost, y1) go down; the receiver copies them into its ghost zone at
+ * the start of its next block.
+ */
+static void postHalo(Domain *d, Mailbox *m, int gy, const float *u2,
+                     const float *u1)
+{
+    const size_t n = (size_t)ghost * nx;
+    float *buf = m->buf[d->block & 1];
+
+    memcpy(buf, u2 + (size_t)(gy - d->ylo) * nx, n * sizeof(float));
+    memcpy(buf + n, u1 + (size_t)(gy - d->ylo) * nx, n * sizeof(float));
+
+    pthread_mutex_lock(&m->lock);
+    m->seq = d->block;
+    pthread_cond_broadcast(&m->ready);
+    pthread_mutex_unlock(&m->lock);
+}
+
+static void takeHalo(Domain *d, Mailbox *m, int gy)
+{
+    const size_t n = (size_t)ghost * nx;
+    const int want = d->block - 1;
+
+    pthread_mutex_lock(&m->lock);
+
+    while (m->seq < want) pthread_cond_wait(&m->ready, &m->lock);
+
+    pthread_mutex_unlock(&m->lock);
+
+    float *buf = m->buf[want & 1];
+    memcpy(d->u2 + (size_t)(gy - d->ylo) * nx, buf, n * sizeof(float));
+    memcpy(d->u1 + (size_t)(gy - d->ylo) * nx, buf + n, n * sizeof(float));
+}
+
+/*
+ * Advance one domain nt <= tb steps in a single sweep. Step s updates rows
+ * [y0 - (nt-1-s)*NPAD, y1 + (nt-1-s)*NPAD), clipped to the rows kernel_2dfd
+ * updates, and runs NPAD rows behind step s-1. Step s reads the level
+ * written by step s-1 and overwrites the one step s-1 read, the same
+ * ping-pong as the d_u1/d_u2 swap.
+ */
+static void sweepBlock(Domain *d, int nt)
+{
+    float *lev[2] = { d->u1, d->u2 };   // lev[0] is written by even steps
+    int lo[MAXTB], hi[MAXTB];
+    int posted = (d->id == 0);
+    int jstart = ny, jstop = 0;
+
+    for (int s = 0; s < nt; s++)
+    {
+        lo[s] = d->y0 - (nt - 1 - s) * NPAD;
+        hi[s] = d->y1 + (nt - 1 - s) * NPAD;
+
+        if (lo[s] < NPAD)      lo[s] = NPAD;
+
+        if (hi[s] > ny - NPAD) hi[s] = ny - NPAD;
+
+        if (lo[s] + s * NPAD < jstart) jstart = lo[s] + s * NPAD;
+
+        if (hi[s] + s * NPAD > jstop)  jstop  = hi[s] + s * NPAD;
+    }
+
+    // the top halo is final once the last step has passed row y0 + ghost
+    const int jtop = d->y0 + ghost + (nt - 1) * NPAD;
+
+    for (int j = jstart; j < jstop; j++)
+    {
+        for (int s = 0; s < nt; s++)
+        {
+            const int gy = j - s * NPAD;
+
+            if (gy < lo[s] || gy >= hi[s]) continue;
+
+            const size_t off = (size_t)(gy - d->ylo) * nx;
+            stencilWave2d(lev[s & 1] + off, lev[(s + 1) & 1] + off, nx, NPAD,
+                          nx - NPAD, NPAD, coef, 0.12f);
+        }
+
+        if (!posted && j + 1 >= jtop)
+        {
+            postHalo(d, &d->up, d->y0, lev[(nt - 1) & 1], lev[nt & 1]);
+            posted = 1;
+        }
+    }
+
+    d->u2 = lev[(nt - 1) & 1];
+    d->u1 = lev[nt & 1];
+
+    if (!posted) postHalo(d, &d->up, d->y0, d->u2, d->u1);
+
+    if (d->id < ndom - 1) postHalo(d, &d->down, d->y1 - ghost, d->u2, d->u1);
+
+    d->block++;
+}
+
+static void *runDomain(void *arg)
+{
+    Domain *d = (Domain *)arg;
+
+    for (int istep = seg_start; istep < seg_stop; )
+    {
+        int nt = seg_stop - istep;
+
+        if (nt > tb) nt = tb;
+
+        // ghosts from the neighbours' last block
+        if (d->block > 0)
+        {
+            if (d->id > 0)
+                takeHalo(d, &dom[d->id - 1].down, d->y0 - ghost);
+
+            if (d->id < ndom - 1)
+                takeHalo(d, &dom[d->id + 1].up, d->y1);
+        }
+
+        sweepBlock(d, nt);
+        istep += nt;
+    }
+
+    return NULL;
+}
+
+static void runSteps(int istart, int istop)
+{
+    pthread_t tid[ndom];
+
+    if (istop <= istart) return;
+
+    seg_start = istart;
+    seg_stop  = istop;
+
+    for (int i = 1; i < ndom; i++)
+        pthread_create(&tid[i], NULL, runDomain, &dom[i]);
+
+    runDomain(&dom[0]);
+
+    for (int i = 1; i < ndom; i++) pthread_join(tid[i], NULL);
+}
+
+static void gatherWave(float *iwave)
+{
+    for (int i = 0; i < ndom; i++)
+    {
+        Domain *d = &dom[i];
+        memcpy(iwave + (size_t)d->y0 * nx, d->u2 + (size_t)(d->y0 - d->ylo) * nx,
+               (size_t)(d->y1 - d->y0) * nx * sizeof(float));
+    }
+}
+
+// copy the wavefield into a staging buffer and let the writer thread save it
+void saveSnapshotIstep(SnapWriter *snap, int istep)
+{
+    float *iwave = snapAcquire(snap);
+
+    gatherWave(iwave);
+    if (snapSubmit(snap, iwave, istep, nx, ny) != 0)
+        fprintf(stderr, "snapshot %d does not fit the staging buffers\n",
+                istep);
+
+    printf("snapshot: nx = %d ny = %d istep = %d\n", nx, ny, istep);
+    fflush(stdout);
+    return;
+}
+
+void checkResult(float *hostRef, float *cpuRef, const int N)
+{
+    double epsilon = 1.0E-6;
+    double maxdiff = 0.0;
+
+    for (int i = 0; i < N; i++)
+    {
+        double diff = fabs(hostRef[i] - cpuRef[i]);
+
+        if (diff > maxdiff) maxdiff = diff;
+    }
+
+    if (maxdiff > epsilon)
+        printf("Arrays do not match! max difference %e\n", maxdiff);
+    else
+        printf("Arrays match.\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    ndom = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (argc > 1) ndom = atoi(argv[1]);
+
+    int iMovie = 10000;
+
+    if (argc > 2) iMovie = atoi(argv[2]);
+
+    tb = 4;
+
+    if (argc > 3) tb = atoi(argv[3]);
+
+    // size
+    const int nsteps  = 600;
+
+    // snapshot period, compression mode and error bound for SNAP_BOUNDED
+    int iSnap = nsteps;
+    int mode  = SNAP_LOSSLESS;
+    float tol = 1.0e-5f;
+
+    if (argc > 4) iSnap = atoi(argv[4]);
+
+    if (argc > 5) mode = atoi(argv[5]);
+
+    if (argc > 6) tol = (float)atof(argv[6]);
+
+    if (iSnap < 1) iSnap = nsteps;
+    nx = 512;
+    ny = 512;
+
+    if (ndom < 1) ndom = 1;
+
+    if (ndom > ny / NPAD2) ndom = ny / NPAD2;
+
+    if (tb < 1) tb = 1;
+
+    if (tb > MAXTB) tb = MAXTB;
+
+    // a domain must own at least as many rows as its neighbours' ghost zones
+    while (tb > 1 && tb * NPAD > ny / ndom) tb--;
+
+    ghost = tb * NPAD;
+
+    printf("> run with %d domains, %d steps per halo exchange\n", ndom, tb);
+
+    // set up domains
+    dom = (Domain *)calloc(ndom, sizeof(Domain));
+
+    for (int i = 0; i < ndom; i++)
+    {
+        Domain *d = &dom[i];
+        d->id    = i;
+        d->y0    = i * ny / ndom;
+        d->y1    = (i + 1) * ny / ndom;
+        d->ylo   = d->y0 - ghost;
+        d->nrows = d->y1 - d->y0 + 2 * ghost;
+
+        size_t ibyte = (size_t)d->nrows * nx * sizeof(float);
+        d->u1 = (float *)hostMalloc(ibyte);
+        d->u2 = (float *)hostMalloc(ibyte);
+        initialData(d->u1, d->nrows * nx);
+        initialData(d->u2, d->nrows * nx);
+
+        Mailbox *m[2] = { &d->up, &d->down };
+
+        for (int k = 0; k < 2; k++)
+        {
+            m[k]->buf[0] = (float *)malloc(4 * (size_t)ghost * nx * sizeof(float));
+            m[k]->buf[1] = m[k]->buf[0] + 2 * (size_t)ghost * nx;
+            m[k]->seq = -1;
+            pthread_mutex_init(&m[k]->lock, NULL);
+            pthread_cond_init(&m[k]->ready, NULL);
+        }
+
+        printf("domain %i: rows %d - %d, allocated %.2f MB\n", i, d->y0,
+               d->y1 - 1, (2.f * ibyte) / (1024.f * 1024.f));
+    }
+
+    SnapWriter snap;
+
+    if (snapOpen(&snap, "snapshots.snap", 3, (size_t)nx * ny, mode, tol,
+                 hostMalloc, hostFree) != 0)
+    {
+        fprintf(stderr, "cannot open snapshots.snap\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // main loop for wave propagation, split at the snapshot steps
+    double iStart = seconds();
+    int istep = 0;
+    int next  = iMovie;
+
+    if (next == 0)
+    {
+        saveSnapshotIstep(&snap, 0);
+        next += iSnap;
+    }
+
+    addWavelet(20.0f);
+
+    while (istep < nsteps)
+    {
+        int stop = (next > istep && next < nsteps) ? next : nsteps;
+        runSteps(istep, stop);
+        istep = stop;
+
+        if (istep == next && istep < nsteps)
+        {
+            saveSnapshotIstep(&snap, istep);
+            next += iSnap;
+        }
+    }
+
+    double iElaps = (seconds() - iStart) * 1e3 / nsteps;
+    printf("cputime: %8.2fms ", iElaps);
+    printf("performance: %8.2f MCells/s\n",
+           (double) nx * ny / (iElaps * 1e3f) );
+    fflush(stdout);
+
+    if (snapClose(&snap) != 0)
+        fprintf(stderr, "error writing snapshots.snap\n");
+
+    // check against the GPU arithmetic run serially on the whole grid
+    float *h_u1 = (float *)malloc(nx * ny * sizeof(float));
+    float *h_u2 = (float *)malloc(nx * ny * sizeof(float));
+    float *cpuRef = (float *)malloc(nx * ny * sizeof(float));
+    initialData(h_u1, nx * ny);
+    initialData(h_u2, nx * ny);
+    h_u2[waveletRow() * nx + nx / 2] += 20.0f;
+
+    for (istep = 0; istep < nsteps; istep++)
+    {
+        fd_step_host(h_u1, h_u2);
+        float *tmpu0 = h_u1;
+        h_u1 = h_u2;
+        h_u2 = tmpu0;
+    }
+
+    gatherWave(cpuRef);
+    checkResult(h_u2, cpuRef, nx * ny);
+
+    // clear
+    for (int i = 0; i < ndom; i++)
+    {
+        hostFree(dom[i].u1);
+        hostFree(dom[i].u2);
+        free(dom[i].up.buf[0]);
+        free(dom[i].down.buf[0]);
+        pthread_mutex_destroy(&dom[i].up.lock);
+        pthread_mutex_destroy(&dom[i].down.lock);
+        pthread_cond_destroy(&dom[i].up.ready);
+        pthread_cond_destroy(&dom[i].down.ready);
+    }
+
+    free(dom);
+    free(h_u1);
+    free(h_u2);
+    free(cpuRef);
+    hostPrintStats("host memory");
+    hostTrim();
+
+    return EXIT_SUCCESS;
+}
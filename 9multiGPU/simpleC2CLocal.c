@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "../common/transport.h"
+
+/*
+ * simpleC2C.c without MPI: the same exchange of a char* between two peers,
+ * both sending and receiving size bytes at once, repeated LOOP_LARGE times
+ * for sizes of 1 KB to 4 MB, over the local transports of
+ * common/transport.h:
+ *
+ *   thread ring   the peer is a second thread of this process
+ *   shm ring      the peer is a child process sharing the rings
+ *   unix socket   the peer is a child process at the other end of a socket
+ *
+ * Latency is counted as in simpleC2C.c, half the time of one exchange, and
+ * bandwidth is the size over that latency. The peers synchronize before
+ * every size with an exchange of one byte, and the received bytes are
+ * checked after the last exchange of every size.
+ */
+
+#define MESSAGE_ALIGNMENT 64
+#define MAX_MSG_SIZE (1<<22)
+#define MYBUFSIZE MAX_MSG_SIZE
+#define LOOP_LARGE  100
+
+typedef struct
+{
+    XferEnd e;
+    int rank;
+    int loop;
+    int err;
+} Peer;
+
+double seconds()
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+void initalData (void * sbuf, void * rbuf, size_t size, int rank)
+{
+    memset(sbuf, 'a' + rank, size);
+    memset(rbuf, 'z', size);
+}
+
+// the exchange of simpleC2C.c; rank 0 times it and prints
+void *sweep(void *arg)
+{
+    Peer *p = (Peer *)arg;
+    char token = 0;
+    char *s_buf = NULL, *r_buf = NULL;
+
+    if (posix_memalign((void **)&s_buf, MESSAGE_ALIGNMENT, MYBUFSIZE) != 0 ||
+            posix_memalign((void **)&r_buf, MESSAGE_ALIGNMENT, MYBUFSIZE) != 0)
+    {
+        fprintf(stderr, "rank %d: out of memory\n", p->rank);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int size = 1024; size <= MAX_MSG_SIZE; size = size * 4)
+    {
+        initalData(s_buf, r_buf, size, p->rank);
+
+        // barrier
+        if (xferExchange(&p->e, &token, &token, 1) != 0)
+        {
+            p->err = 1;
+            break;
+        }
+
+        double tstart = seconds();
+
+        for (int i = 0; i < p->loop; i++)
+        {
+            if (xferExchange(&p->e, s_buf, r_buf, size) != 0)
+            {
+                p->err = 1;
+                break;
+            }
+        }
+
+        double tend = seconds();
+
+        for (int i = 0; i < size; i++)
+        {
+            if (r_buf[i] != 'a' + 1 - p->rank)
+            {
+                p->err = 1;
+                break;
+            }
+        }
+
+        if (p->err) break;
+
+        if (p->rank == 0)
+        {
+            double latency = (tend - tstart) * 1e6 / (2.0 * p->loop);
+            printf("%6d %s %10.2f μs %10.2f MB/sec %8.2f GB/sec\n",
+                   (size >= 1024 * 1024) ? size / 1024 / 1024 : size / 1024,
+                   (size >= 1024 * 1024) ? "MB" : "KB", latency,
+                   size / latency, size / latency / 1e3);
+            fflush(stdout);
+        }
+    }
+
+    free(s_buf);
+    free(r_buf);
+
+    return NULL;
+}
+
+int run(XferKind kind, int loop)
+{
+    Peer p[2];
+
+    if (xferPair(kind, &p[0].e, &p[1].e) != 0)
+    {
+        fprintf(stderr, "%s: cannot create the transport\n",
+                xferKindName(kind));
+        return 1;
+    }
+
+    for (int r = 0; r < 2; r++)
+    {
+        p[r].rank = r;
+        p[r].loop = loop;
+        p[r].err = 0;
+    }
+
+    printf("%s\n", xferKindName(kind));
+
+    if (kind == XFER_THREAD)
+    {
+        pthread_t tid;
+
+        pthread_create(&tid, NULL, sweep, &p[1]);
+        sweep(&p[0]);
+        pthread_join(tid, NULL);
+        xferClose(&p[1].e);
+        xferClose(&p[0].e);
+    }
+    else
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+
+        if (pid < 0)
+        {
+            perror("fork");
+            return 1;
+        }
+
+        // each process closes the end it does not use
+        if (pid == 0)
+        {
+            xferClose(&p[0].e);
+            sweep(&p[1]);
+            xferClose(&p[1].e);
+            _exit(p[1].err ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        xferClose(&p[1].e);
+        sweep(&p[0]);
+        xferClose(&p[0].e);
+
+        int status;
+        waitpid(pid, &status, 0);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) p[1].err = 1;
+    }
+
+    if (p[0].err || p[1].err)
+    {
+        fprintf(stderr, "%s: exchange failed\n", xferKindName(kind));
+        return 1;
+    }
+
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int loop = LOOP_LARGE;
+    int err = 0;
+
+    if (argc > 1) loop = atoi(argv[1]);
+
+    printf("%s allocates %d MB dynamic memory aligned to 64 byte per peer, "
+           "%d exchanges per size\n", argv[0], 2 * MAX_MSG_SIZE / 1024 / 1024,
+           loop);
+
+    err |= run(XFER_THREAD, loop);
+    err |= run(XFER_SHM, loop);
+    err |= run(XFER_SOCKET, loop);
+
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,980 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#ifndef _FFT_H
+#define _FFT_H
+
+/*
+ * Host batched FFT with the plan API of cuFFT, in single precision:
+ *
+ *   cuFFT                         here
+ *   cufftComplex                  FftComplex
+ *   cufftPlan1d(&plan, n, t, b)   fftPlan1d(&plan, n, t, b)
+ *   cufftPlanMany (1D, advanced   fftPlanMany(&plan, n, t, b, istride,
+ *   layout)                         idist, ostride, odist, nthreads)
+ *   cufftExecC2C, R2C, C2R        fftExecC2C, fftExecR2C, fftExecC2R
+ *   cufftDestroy                  fftDestroy
+ *
+ * As in cuFFT, transforms are not normalized, an inverse after a forward
+ * transform scales by n; R2C writes the n / 2 + 1 non-redundant outputs and
+ * C2R reads them; in == out is an in-place transform. Element j of line b
+ * is in[b * idist + j * istride], counted in floats for real data and in
+ * complex values otherwise; fftPlan1d lays lines end to end, except that
+ * in place the real lines are padded to 2 * (n / 2 + 1) floats, the
+ * layout of cuFFT and FFTW, so that every line is written over its own
+ * input. A batch of real transforms in place with fftPlanMany needs the
+ * same: a real distance of twice the complex one.
+ *
+ * A transform is a Stockham autosort: n is factored into radix 4, then 2,
+ * then 3 and other primes, and each factor is one pass from one scratch
+ * line to the other, in natural order at the end. Radix 2 and 4 have AVX
+ * butterflies on four complex values at a time; 3 has its own scalar one
+ * and the others go through a general butterfly. Inverse transforms run
+ * the forward passes on conjugated data. A real transform of even length
+ * is a complex one of half the length plus one pass to split the spectrum;
+ * an odd length is done as a complex transform.
+ *
+ * The twiddles of every pass are computed once per length, in double
+ * precision with sin and cos, and kept in a cache shared by all plans of
+ * that length; fftCacheFree releases the entries no plan uses.
+ *
+ * An exec splits the batch over POSIX threads, one run of lines each with
+ * its own scratch lines. When there are fewer lines than threads and they
+ * are at least FFT_SPLIT long (the case cufft-multi.cu hands to two GPUs),
+ * every pass of each line is split over the threads instead, by groups of
+ * butterflies, with a barrier between passes. A thread that cannot be
+ * started leaves its lines to the calling thread, or its share of the
+ * passes to the threads that did start. The functions returning int give
+ * 0, or -1 when out of memory or when the call does not fit the plan.
+ */
+
+typedef struct
+{
+    float x, y;
+} FftComplex;
+
+typedef enum
+{
+    FFT_C2C,
+    FFT_R2C,
+    FFT_C2R
+} FftType;
+
+// the exponent sign, as CUFFT_FORWARD and CUFFT_INVERSE
+#define FFT_FORWARD     (-1)
+#define FFT_INVERSE     1
+
+#define FFT_MAX_PASSES  32
+
+// points below which a thread is not worth starting
+#define FFT_MIN_WORK    (1 << 14)
+
+// length from which the passes of a single line are split over threads
+#ifndef FFT_SPLIT
+#define FFT_SPLIT       (1 << 16)
+#endif
+
+#define FFT_ALIGN       64
+
+#define FFT_PI          3.14159265358979323846
+
+typedef struct FftTwiddles
+{
+    int n;
+    int npass;
+    int radix[FFT_MAX_PASSES];
+    int maxRadix;
+
+    // pass i, n / s = r * m points: w[i][(k - 1) * m + p] is
+    // exp(-2 pi i p k / (r * m)); roots[i][j] is exp(-2 pi i j / r)
+    FftComplex *w[FFT_MAX_PASSES];
+    FftComplex *roots[FFT_MAX_PASSES];
+    FftComplex *table;
+
+    int refs;
+    struct FftTwiddles *next;
+} FftTwiddles;
+
+typedef struct
+{
+    FftType type;
+    int n, batch;
+    int istride, idist, ostride, odist;
+    int nthreads;
+    int padded;             // fftPlan1d: real lines padded in place
+
+    int nc;                 // length of the complex transform
+    FftTwiddles *tw;
+    FftComplex *half;       // exp(-2 pi i k / n), k <= n / 2, for even R2C/C2R
+    FftComplex *work;       // per thread two lines and a general butterfly
+    size_t workLen;
+} FftPlan;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int n, count, phase;
+} FftBarrier;
+
+typedef struct
+{
+    const FftPlan *plan;
+    const void *in;
+    void *out;
+    int dir;
+
+    int b0, b1;             // lines
+    int tid, nt;            // part of every pass, when lines are split
+    FftBarrier *bar;
+    FftComplex *a, *b, *scratch;
+} FftJob;
+
+static FftTwiddles *fftCache = NULL;
+static pthread_mutex_t fftCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline FftComplex fftMul(FftComplex a, FftComplex b)
+{
+    FftComplex c = { a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x };
+    return c;
+}
+
+static inline FftComplex fftAdd(FftComplex a, FftComplex b)
+{
+    FftComplex c = { a.x + b.x, a.y + b.y };
+    return c;
+}
+
+static inline FftComplex fftSub(FftComplex a, FftComplex b)
+{
+    FftComplex c = { a.x - b.x, a.y - b.y };
+    return c;
+}
+
+// -i a
+static inline FftComplex fftMulMi(FftComplex a)
+{
+    FftComplex c = { a.y, -a.x };
+    return c;
+}
+
+static inline FftComplex fftConj(FftComplex a)
+{
+    FftComplex c = { a.x, -a.y };
+    return c;
+}
+
+static inline FftComplex fftExp(double num, double den)
+{
+    double t = -2.0 * FFT_PI * num / den;
+    FftComplex c = { (float)cos(t), (float)sin(t) };
+    return c;
+}
+
+#if defined(__AVX__)
+
+// four complex values a times one w, given as its broadcast parts
+static inline __m256 fftMul4(__m256 a, __m256 wr, __m256 wi)
+{
+    __m256 sw = _mm256_permute_ps(a, 0xB1);
+
+    return _mm256_addsub_ps(_mm256_mul_ps(a, wr), _mm256_mul_ps(sw, wi));
+}
+
+// four complex values a times four w
+static inline __m256 fftMulV4(__m256 a, __m256 w)
+{
+    return fftMul4(a, _mm256_moveldup_ps(w), _mm256_movehdup_ps(w));
+}
+
+static inline __m256 fftMulMi4(__m256 a)
+{
+    const __m256 odd = _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f,
+                                      0.0f, -0.0f);
+
+    return _mm256_xor_ps(_mm256_permute_ps(a, 0xB1), odd);
+}
+
+#endif
+
+/*
+ * The passes: n / s = r * m points, for p in [p0, p1) and q in [q0, q1)
+ * y[q + s * (r * p + k)] = w^(p k) sum_j x[q + s * (p + j * m)] W_r^(j k).
+ */
+static void fftPass2(const FftComplex *x, FftComplex *y, const int m,
+                     const int s, const int p0, const int p1, const int q0,
+                     const int q1, const FftComplex *w)
+{
+    for (int p = p0; p < p1; p++)
+    {
+        const FftComplex w1 = w[p];
+        const FftComplex *x0 = x + (size_t)s * p;
+        const FftComplex *x1 = x0 + (size_t)s * m;
+        FftComplex *y0 = y + (size_t)s * 2 * p;
+        FftComplex *y1 = y0 + s;
+        int q = q0;
+
+#if defined(__AVX__)
+        const __m256 wr = _mm256_set1_ps(w1.x), wi = _mm256_set1_ps(w1.y);
+
+        for (; q + 4 <= q1; q += 4)
+        {
+            __m256 a0 = _mm256_loadu_ps((const float *)(x0 + q));
+            __m256 a1 = _mm256_loadu_ps((const float *)(x1 + q));
+
+            _mm256_storeu_ps((float *)(y0 + q), _mm256_add_ps(a0, a1));
+            _mm256_storeu_ps((float *)(y1 + q),
+                             fftMul4(_mm256_sub_ps(a0, a1), wr, wi));
+        }
+#endif
+
+        for (; q < q1; q++)
+        {
+            y0[q] = fftAdd(x0[q], x1[q]);
+            y1[q] = fftMul(fftSub(x0[q], x1[q]), w1);
+        }
+    }
+}
+
+static void fftPass4(const FftComplex *x, FftComplex *y, const int m,
+                     const int s, int p0, const int p1, const int q0,
+                     const int q1, const FftComplex *w)
+{
+    const size_t sm = (size_t)s * m;
+
+#if defined(__AVX__)
+    /*
+     * The first pass, s = 1, has no run of q: four p at a time instead,
+     * the twiddles loaded as vectors and the outputs of each p brought
+     * together by a 4 x 4 transpose of complex values.
+     */
+    if (s == 1)
+    {
+        for (; p0 + 4 <= p1; p0 += 4)
+        {
+            __m256 a0 = _mm256_loadu_ps((const float *)(x + p0));
+            __m256 a1 = _mm256_loadu_ps((const float *)(x + m + p0));
+            __m256 a2 = _mm256_loadu_ps((const float *)(x + 2 * m + p0));
+            __m256 a3 = _mm256_loadu_ps((const float *)(x + 3 * m + p0));
+            __m256 t0 = _mm256_add_ps(a0, a2);
+            __m256 t1 = _mm256_sub_ps(a0, a2);
+            __m256 t2 = _mm256_add_ps(a1, a3);
+            __m256 t3 = fftMulMi4(_mm256_sub_ps(a1, a3));
+            __m256 w1 = _mm256_loadu_ps((const float *)(w + p0));
+            __m256 w2 = _mm256_loadu_ps((const float *)(w + m + p0));
+            __m256 w3 = _mm256_loadu_ps((const float *)(w + 2 * m + p0));
+
+            __m256d b0 = _mm256_castps_pd(_mm256_add_ps(t0, t2));
+            __m256d b1 = _mm256_castps_pd(fftMulV4(_mm256_add_ps(t1, t3), w1));
+            __m256d b2 = _mm256_castps_pd(fftMulV4(_mm256_sub_ps(t0, t2), w2));
+            __m256d b3 = _mm256_castps_pd(fftMulV4(_mm256_sub_ps(t1, t3), w3));
+            __m256d c0 = _mm256_unpacklo_pd(b0, b1);
+            __m256d c1 = _mm256_unpackhi_pd(b0, b1);
+            __m256d c2 = _mm256_unpacklo_pd(b2, b3);
+            __m256d c3 = _mm256_unpackhi_pd(b2, b3);
+            double *y0 = (double *)(y + 4 * p0);
+
+            _mm256_storeu_pd(y0, _mm256_permute2f128_pd(c0, c2, 0x20));
+            _mm256_storeu_pd(y0 + 4, _mm256_permute2f128_pd(c1, c3, 0x20));
+            _mm256_storeu_pd(y0 + 8, _mm256_permute2f128_pd(c0, c2, 0x31));
+            _mm256_storeu_pd(y0 + 12, _mm256_permute2f128_pd(c1, c3, 0x31));
+        }
+    }
+#endif
+
+    for (int p = p0; p < p1; p++)
+    {
+        const FftComplex w1 = w[p], w2 = w[m + p], w3 = w[2 * m + p];
+        const FftComplex *x0 = x + (size_t)s * p;
+        FftComplex *y0 = y + (size_t)s * 4 * p;
+        int q = q0;
+
+#if defined(__AVX__)
+        const __m256 w1r = _mm256_set1_ps(w1.x), w1i = _mm256_set1_ps(w1.y);
+        const __m256 w2r = _mm256_set1_ps(w2.x), w2i = _mm256_set1_ps(w2.y);
+        const __m256 w3r = _mm256_set1_ps(w3.x), w3i = _mm256_set1_ps(w3.y);
+
+        for (; q + 4 <= q1; q += 4)
+        {
+            __m256 a0 = _mm256_loadu_ps((const float *)(x0 + q));
+            __m256 a1 = _mm256_loadu_ps((const float *)(x0 + sm + q));
+            __m256 a2 = _mm256_loadu_ps((const float *)(x0 + 2 * sm + q));
+            __m256 a3 = _mm256_loadu_ps((const float *)(x0 + 3 * sm + q));
+            __m256 t0 = _mm256_add_ps(a0, a2);
+            __m256 t1 = _mm256_sub_ps(a0, a2);
+            __m256 t2 = _mm256_add_ps(a1, a3);
+            __m256 t3 = fftMulMi4(_mm256_sub_ps(a1, a3));
+
+            _mm256_storeu_ps((float *)(y0 + q), _mm256_add_ps(t0, t2));
+            _mm256_storeu_ps((float *)(y0 + s + q),
+                             fftMul4(_mm256_add_ps(t1, t3), w1r, w1i));
+            _mm256_storeu_ps((float *)(y0 + 2 * s + q),
+                             fftMul4(_mm256_sub_ps(t0, t2), w2r, w2i));
+            _mm256_storeu_ps((float *)(y0 + 3 * s + q),
+                             fftMul4(_mm256_sub_ps(t1, t3), w3r, w3i));
+        }
+#endif
+
+        for (; q < q1; q++)
+        {
+            FftComplex t0 = fftAdd(x0[q], x0[2 * sm + q]);
+            FftComplex t1 = fftSub(x0[q], x0[2 * sm + q]);
+            FftComplex t2 = fftAdd(x0[sm + q], x0[3 * sm + q]);
+            FftComplex t3 = fftMulMi(fftSub(x0[sm + q], x0[3 * sm + q]));
+
+            y0[q] = fftAdd(t0, t2);
+            y0[s + q] = fftMul(fftAdd(t1, t3), w1);
+            y0[2 * s + q] = fftMul(fftSub(t0, t2), w2);
+            y0[3 * s + q] = fftMul(fftSub(t1, t3), w3);
+        }
+    }
+}
+
+static void fftPass3(const FftComplex *x, FftComplex *y, const int m,
+                     const int s, const int p0, const int p1, const int q0,
+                     const int q1, const FftComplex *w)
+{
+    const float h = 0.866025403784438646764f;   // sin(pi / 3)
+    const size_t sm = (size_t)s * m;
+
+    for (int p = p0; p < p1; p++)
+    {
+        const FftComplex w1 = w[p], w2 = w[m + p];
+        const FftComplex *x0 = x + (size_t)s * p;
+        FftComplex *y0 = y + (size_t)s * 3 * p;
+
+        for (int q = q0; q < q1; q++)
+        {
+            FftComplex a0 = x0[q], a1 = x0[sm + q], a2 = x0[2 * sm + q];
+            FftComplex t1 = fftAdd(a1, a2);
+            FftComplex t2 = { a0.x - 0.5f * t1.x, a0.y - 0.5f * t1.y };
+            FftComplex d = fftMulMi(fftSub(a1, a2));
+            FftComplex t3 = { h * d.x, h * d.y };
+
+            y0[q] = fftAdd(a0, t1);
+            y0[s + q] = fftMul(fftAdd(t2, t3), w1);
+            y0[2 * s + q] = fftMul(fftSub(t2, t3), w2);
+        }
+    }
+}
+
+// any radix r, in r^2 multiplies, through r values of scratch
+static void fftPassN(const FftComplex *x, FftComplex *y, const int r,
+                     const int m, const int s, const int p0, const int p1,
+                     const int q0, const int q1, const FftComplex *w,
+                     const FftComplex *roots, FftComplex *a)
+{
+    const size_t sm = (size_t)s * m;
+
+    for (int p = p0; p < p1; p++)
+    {
+        const FftComplex *x0 = x + (size_t)s * p;
+        FftComplex *y0 = y + (size_t)s * r * p;
+
+        for (int q = q0; q < q1; q++)
+        {
+            for (int j = 0; j < r; j++) a[j] = x0[j * sm + q];
+
+            for (int k = 0; k < r; k++)
+            {
+                FftComplex sum = a[0];
+
+                for (int j = 1, jk = k; j < r; j++, jk = (jk + k) % r)
+                    sum = fftAdd(sum, fftMul(a[j], roots[jk]));
+
+                y0[(size_t)k * s + q] = k == 0 ? sum :
+                                        fftMul(sum, w[(size_t)(k - 1) * m + p]);
+            }
+        }
+    }
+}
+
+static inline void fftBarrierWait(FftBarrier *b)
+{
+    pthread_mutex_lock(&b->lock);
+
+    const int phase = b->phase;
+
+    if (++b->count == b->n)
+    {
+        b->count = 0;
+        b->phase++;
+        pthread_cond_broadcast(&b->cond);
+    }
+    else
+    {
+        while (b->phase == phase) pthread_cond_wait(&b->cond, &b->lock);
+    }
+
+    pthread_mutex_unlock(&b->lock);
+}
+
+static inline void fftSync(const FftJob *j)
+{
+    if (j->nt > 1) fftBarrierWait(j->bar);
+}
+
+// [i0, i1) of n, part tid of nt, bounds multiples of align
+static inline void fftRange(const int n, const int tid, const int nt,
+                            const int align, int *i0, int *i1)
+{
+    const int units = (n + align - 1) / align;
+
+    *i0 = (int)((long)units * tid / nt) * align;
+    *i1 = (int)((long)units * (tid + 1) / nt) * align;
+
+    if (*i1 > n) *i1 = n;
+}
+
+/*
+ * All passes of one line, from a, ping-ponging with b; returns the line
+ * holding the result.
+ */
+static FftComplex *fftTransform(const FftJob *j, FftComplex *a, FftComplex *b)
+{
+    const FftTwiddles *t = j->plan->tw;
+    int s = 1;
+
+    for (int i = 0; i < t->npass; i++)
+    {
+        const int r = t->radix[i], m = t->n / (s * r);
+        int p0 = 0, p1 = m, q0 = 0, q1 = s;
+
+        // split the butterflies by p, or by q in the last passes
+        if (j->nt > 1)
+        {
+            if (m >= j->nt)
+                fftRange(m, j->tid, j->nt, 1, &p0, &p1);
+            else
+                fftRange(s, j->tid, j->nt, 4, &q0, &q1);
+        }
+
+        if (r == 4)
+            fftPass4(a, b, m, s, p0, p1, q0, q1, t->w[i]);
+        else if (r == 2)
+            fftPass2(a, b, m, s, p0, p1, q0, q1, t->w[i]);
+        else if (r == 3)
+            fftPass3(a, b, m, s, p0, p1, q0, q1, t->w[i]);
+        else
+            fftPassN(a, b, r, m, s, p0, p1, q0, q1, t->w[i], t->roots[i],
+                     j->scratch);
+
+        fftSync(j);
+
+        FftComplex *c = a;
+        a = b;
+        b = c;
+        s *= r;
+    }
+
+    return a;
+}
+
+// line l: gather, transform, scatter; this thread's share when split
+static void fftLine(const FftJob *j, const int l)
+{
+    const FftPlan *p = j->plan;
+    const int nc = p->nc, n = p->n;
+    const int inverse = j->dir == FFT_INVERSE;
+    FftComplex *a = j->a;
+    int i0, i1;
+
+    fftRange(nc, j->tid, j->nt, 1, &i0, &i1);
+
+    if (p->type == FFT_R2C)
+    {
+        const float *x = (const float *)j->in + (size_t)l * p->idist;
+        const size_t is = p->istride;
+
+        // pairs of samples as one complex value, or the samples alone
+        for (int i = i0; i < i1; i++)
+        {
+            if (nc < n)
+            {
+                a[i].x = x[(size_t)2 * i * is];
+                a[i].y = x[(size_t)(2 * i + 1) * is];
+            }
+            else
+            {
+                a[i].x = x[(size_t)i * is];
+                a[i].y = 0.0f;
+            }
+        }
+    }
+    else if (p->type == FFT_C2R && nc < n)
+    {
+        const FftComplex *x = (const FftComplex *)j->in + (size_t)l * p->idist;
+        const size_t is = p->istride;
+
+        // the half-length spectrum of the pairs, conjugated
+        for (int k = i0; k < i1; k++)
+        {
+            FftComplex xk = x[(size_t)k * is];
+            FftComplex xc = fftConj(x[(size_t)(nc - k) * is]);
+            FftComplex e = fftAdd(xk, xc);
+            FftComplex o = fftMul(fftSub(xk, xc), fftConj(p->half[k]));
+            FftComplex z = { e.x - o.y, e.y + o.x };
+
+            a[k] = fftConj(z);
+        }
+    }
+    else if (p->type == FFT_C2R)
+    {
+        const FftComplex *x = (const FftComplex *)j->in + (size_t)l * p->idist;
+        const size_t is = p->istride;
+
+        // the whole hermitian spectrum, conjugated
+        for (int k = i0; k < i1; k++)
+        {
+            a[k] = k <= n / 2 ? fftConj(x[(size_t)k * is]) :
+                   x[(size_t)(n - k) * is];
+        }
+    }
+    else
+    {
+        const FftComplex *x = (const FftComplex *)j->in + (size_t)l * p->idist;
+        const size_t is = p->istride;
+
+        for (int i = i0; i < i1; i++)
+            a[i] = inverse ? fftConj(x[(size_t)i * is]) : x[(size_t)i * is];
+    }
+
+    fftSync(j);
+
+    const FftComplex *z = fftTransform(j, a, j->b);
+
+    if (p->type == FFT_R2C)
+    {
+        FftComplex *y = (FftComplex *)j->out + (size_t)l * p->odist;
+        const size_t os = p->ostride;
+
+        fftRange(n / 2 + 1, j->tid, j->nt, 1, &i0, &i1);
+
+        for (int k = i0; k < i1; k++)
+        {
+            if (nc == n)
+            {
+                y[(size_t)k * os] = z[k];
+                continue;
+            }
+
+            // X_k = (Z_k + Z*_(n/2-k)) / 2 - i w^k (Z_k - Z*_(n/2-k)) / 2
+            FftComplex zk = z[k % nc], zc = fftConj(z[(nc - k) % nc]);
+            FftComplex e = fftAdd(zk, zc);
+            FftComplex o = fftMul(fftSub(zk, zc), p->half[k]);
+            FftComplex v = { 0.5f * (e.x + o.y), 0.5f * (e.y - o.x) };
+
+            y[(size_t)k * os] = v;
+        }
+    }
+    else if (p->type == FFT_C2R)
+    {
+        float *y = (float *)j->out + (size_t)l * p->odist;
+        const size_t os = p->ostride;
+
+        for (int i = i0; i < i1; i++)
+        {
+            if (nc < n)
+            {
+                y[(size_t)2 * i * os] = z[i].x;
+                y[(size_t)(2 * i + 1) * os] = -z[i].y;
+            }
+            else
+            {
+                y[(size_t)i * os] = z[i].x;
+            }
+        }
+    }
+    else
+    {
+        FftComplex *y = (FftComplex *)j->out + (size_t)l * p->odist;
+        const size_t os = p->ostride;
+
+        for (int i = i0; i < i1; i++)
+            y[(size_t)i * os] = inverse ? fftConj(z[i]) : z[i];
+    }
+
+    // the next line reuses the scratch lines
+    fftSync(j);
+}
+
+static void *fftLines(void *arg)
+{
+    FftJob *j = (FftJob *)arg;
+
+    for (int l = j->b0; l < j->b1; l++) fftLine(j, l);
+
+    return NULL;
+}
+
+// a share of every pass, once fftExec has counted the threads started
+static void *fftShare(void *arg)
+{
+    FftJob *j = (FftJob *)arg;
+
+    pthread_mutex_lock(&j->bar->lock);
+    pthread_mutex_unlock(&j->bar->lock);
+
+    return fftLines(j);
+}
+
+static inline void fftTwiddlesFree(FftTwiddles *t)
+{
+    free(t->table);
+    free(t);
+}
+
+static FftTwiddles *fftTwiddlesCreate(const int n)
+{
+    FftTwiddles *t = (FftTwiddles *)calloc(1, sizeof(FftTwiddles));
+    size_t len = 0;
+
+    if (t == NULL) return NULL;
+
+    t->n = n;
+    t->maxRadix = 1;
+
+    // radix 4 first, then 2, 3 and the other primes
+    for (int rest = n, f = 4; rest > 1;)
+    {
+        if (rest % f == 0)
+        {
+            t->radix[t->npass++] = f;
+            rest /= f;
+
+            if (f > t->maxRadix) t->maxRadix = f;
+        }
+        else
+        {
+            f = f == 4 ? 2 : f == 2 ? 3 : f + 2;
+        }
+    }
+
+    for (int i = 0, s = 1; i < t->npass; s *= t->radix[i], i++)
+    {
+        const int r = t->radix[i];
+
+        len += (size_t)(r - 1) * (n / (s * r)) + (r > 4 ? r : 0);
+    }
+
+    t->table = (FftComplex *)malloc((len > 0 ? len : 1) * sizeof(FftComplex));
+
+    if (t->table == NULL)
+    {
+        free(t);
+        return NULL;
+    }
+
+    FftComplex *w = t->table;
+
+    for (int i = 0, s = 1; i < t->npass; s *= t->radix[i], i++)
+    {
+        const int r = t->radix[i], m = n / (s * r);
+
+        t->w[i] = w;
+
+        for (int k = 1; k < r; k++)
+            for (int p = 0; p < m; p++)
+                *w++ = fftExp((double)p * k, (double)r * m);
+
+        if (r > 4)
+        {
+            t->roots[i] = w;
+
+            for (int k = 0; k < r; k++) *w++ = fftExp(k, r);
+        }
+    }
+
+    return t;
+}
+
+// the twiddles of length n from the cache, computing them on first use
+static FftTwiddles *fftTwiddlesGet(const int n)
+{
+    FftTwiddles *t;
+
+    pthread_mutex_lock(&fftCacheLock);
+
+    for (t = fftCache; t != NULL && t->n != n; t = t->next);
+
+    if (t == NULL && (t = fftTwiddlesCreate(n)) != NULL)
+    {
+        t->next = fftCache;
+        fftCache = t;
+    }
+
+    if (t != NULL) t->refs++;
+
+    pthread_mutex_unlock(&fftCacheLock);
+
+    return t;
+}
+
+static inline void fftTwiddlesRelease(FftTwiddles *t)
+{
+    pthread_mutex_lock(&fftCacheLock);
+    t->refs--;
+    pthread_mutex_unlock(&fftCacheLock);
+}
+
+// free the cached twiddles no plan holds
+static inline void fftCacheFree(void)
+{
+    pthread_mutex_lock(&fftCacheLock);
+
+    for (FftTwiddles **t = &fftCache; *t != NULL;)
+    {
+        FftTwiddles *c = *t;
+
+        if (c->refs == 0)
+        {
+            *t = c->next;
+            fftTwiddlesFree(c);
+        }
+        else
+        {
+            t = &c->next;
+        }
+    }
+
+    pthread_mutex_unlock(&fftCacheLock);
+}
+
+static inline void fftDestroy(FftPlan *p)
+{
+    if (p->tw != NULL) fftTwiddlesRelease(p->tw);
+
+    free(p->half);
+    free(p->work);
+    memset(p, 0, sizeof(FftPlan));
+}
+
+/*
+ * batch lines of n points, element j of line b at b * idist + j * istride
+ * in the input and likewise in the output; nthreads < 1 is one thread per
+ * online processor.
+ */
+static inline int fftPlanMany(FftPlan *p, const int n, const FftType type,
+                              const int batch, const int istride,
+                              const int idist, const int ostride,
+                              const int odist, int nthreads)
+{
+    memset(p, 0, sizeof(FftPlan));
+
+    if (n < 1 || batch < 1) return -1;
+
+    if (nthreads < 1) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nthreads < 1) nthreads = 1;
+
+    p->type = type;
+    p->n = n;
+    p->batch = batch;
+    p->istride = istride;
+    p->idist = idist;
+    p->ostride = ostride;
+    p->odist = odist;
+    p->nthreads = nthreads;
+    p->nc = type != FFT_C2C && n % 2 == 0 ? n / 2 : n;
+
+    if ((p->tw = fftTwiddlesGet(p->nc)) == NULL) return -1;
+
+    if (p->nc < n)
+    {
+        p->half = (FftComplex *)malloc((p->nc + 1) * sizeof(FftComplex));
+
+        if (p->half == NULL)
+        {
+            fftDestroy(p);
+            return -1;
+        }
+
+        for (int k = 0; k <= p->nc; k++) p->half[k] = fftExp(k, n);
+    }
+
+    // two lines and the scratch of fftPassN, rounded to whole cache lines
+    p->workLen = (2 * (size_t)p->nc + p->tw->maxRadix + 7) / 8 * 8;
+
+    if (posix_memalign((void **)&p->work, FFT_ALIGN,
+                       nthreads * p->workLen * sizeof(FftComplex)) != 0)
+    {
+        p->work = NULL;
+        fftDestroy(p);
+        return -1;
+    }
+
+    return 0;
+}
+
+// batch lines end to end, as cufftPlan1d
+static inline int fftPlan1d(FftPlan *p, const int n, const FftType type,
+                            const int batch)
+{
+    const int nr = type == FFT_C2C ? n : n / 2 + 1;
+
+    if (fftPlanMany(p, n, type, batch, 1, type == FFT_C2R ? nr : n, 1,
+                    type == FFT_R2C ? nr : n, 0) != 0)
+        return -1;
+
+    p->padded = type != FFT_C2C;
+    return 0;
+}
+
+static int fftExec(const FftPlan *p, const void *in, void *out, const int dir)
+{
+    FftPlan q;
+
+    if (in == out && p->type != FFT_C2C)
+    {
+        // real lines padded to the complex ones, as cuFFT in place
+        q = *p;
+
+        if (p->padded && p->type == FFT_R2C)
+            q.idist = 2 * q.odist;
+        else if (p->padded)
+            q.odist = 2 * q.idist;
+
+        // otherwise a line would be written over the next one's input
+        if (p->batch > 1 && (p->type == FFT_R2C ? q.idist != 2 * q.odist :
+                             q.odist != 2 * q.idist))
+            return -1;
+
+        p = &q;
+    }
+
+    const double work = (double)p->nc * p->batch;
+    int nthreads = p->nthreads;
+
+    if (nthreads > work / FFT_MIN_WORK) nthreads = (int)(work / FFT_MIN_WORK);
+
+    const int split = nthreads > p->batch && p->nc >= FFT_SPLIT;
+
+    if (!split && nthreads > p->batch) nthreads = p->batch;
+
+    if (nthreads < 1) nthreads = 1;
+
+    FftJob g = { p, in, out, dir, 0, p->batch, 0, 1, NULL, p->work,
+                 p->work + p->nc, p->work + 2 * (size_t)p->nc
+               };
+
+    if (nthreads == 1)
+    {
+        fftLines(&g);
+        return 0;
+    }
+
+    pthread_t *tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    FftJob *job = (FftJob *)malloc(nthreads * sizeof(FftJob));
+    FftBarrier bar;
+
+    if (tid == NULL || job == NULL)
+    {
+        free(tid);
+        free(job);
+        return -1;
+    }
+
+    int nstarted = 1;
+
+    if (split)
+    {
+        pthread_mutex_init(&bar.lock, NULL);
+        pthread_cond_init(&bar.cond, NULL);
+        bar.count = 0;
+        bar.phase = 0;
+
+        // the threads wait here until their share is known
+        pthread_mutex_lock(&bar.lock);
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        job[i] = g;
+        job[i].scratch += i * p->workLen;
+
+        if (split)
+        {
+            job[i].bar = &bar;
+        }
+        else
+        {
+            job[i].b0 = (int)((long)p->batch * i / nthreads);
+            job[i].b1 = (int)((long)p->batch * (i + 1) / nthreads);
+            job[i].a += i * p->workLen;
+            job[i].b += i * p->workLen;
+        }
+
+        // none started after the first that fails
+        if (i > 0 && nstarted == i &&
+                pthread_create(&tid[i], NULL, split ? fftShare : fftLines,
+                               &job[i]) == 0)
+            nstarted++;
+    }
+
+    if (split)
+    {
+        // one pair of lines, every thread started a share of each pass
+        for (int i = 0; i < nstarted; i++)
+        {
+            job[i].tid = i;
+            job[i].nt = nstarted;
+        }
+
+        bar.n = nstarted;
+        pthread_mutex_unlock(&bar.lock);
+        fftLines(&job[0]);
+    }
+    else
+    {
+        // the lines of the threads not started, here
+        for (int i = 0; i < nthreads; i++)
+            if (i == 0 || i >= nstarted) fftLines(&job[i]);
+    }
+
+    for (int i = 1; i < nstarted; i++) pthread_join(tid[i], NULL);
+
+    if (split)
+    {
+        pthread_mutex_destroy(&bar.lock);
+        pthread_cond_destroy(&bar.cond);
+    }
+
+    free(tid);
+    free(job);
+    return 0;
+}
+
+static inline int fftExecC2C(const FftPlan *p, const FftComplex *in,
+                             FftComplex *out, const int direction)
+{
+    if (p->type != FFT_C2C ||
+            (direction != FFT_FORWARD && direction != FFT_INVERSE))
+        return -1;
+
+    return fftExec(p, in, out, direction);
+}
+
+static inline int fftExecR2C(const FftPlan *p, const float *in,
+                             FftComplex *out)
+{
+    if (p->type != FFT_R2C) return -1;
+
+    return fftExec(p, in, out, FFT_FORWARD);
+}
+
+static inline int fftExecC2R(const FftPlan *p, const FftComplex *in,
+                             float *out)
+{
+    if (p->type != FFT_C2R) return -1;
+
+    return fftExec(p, in, out, FFT_INVERSE);
+}
+
+#endif // _FFT_H
@@ -0,0 +1,672 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__AVX__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#ifndef _GEMM_H
+#define _GEMM_H
+
+/*
+ * Host GEMM, C = alpha * op(A) * op(B) + beta * C on column-major matrices
+ * as in BLAS, op(X) being X or its transpose: the computation cublasSgemm
+ * does in cublas.cu and drop-in.c hands to NVBLAS.
+ *
+ * The loops are those of GotoBLAS. For every block of KC rows of op(B) and
+ * NC of its columns, the block is packed into panels of NR columns stored
+ * row by row; for every block of MC rows of op(A) over the same KC
+ * columns, that block is packed into panels of MR rows stored column by
+ * column. A micro-kernel then multiplies one A panel by one B panel into
+ * an MR x NR tile of C held in registers. The packed A block stays in L2
+ * and the B panel in L1 while the micro-kernel streams through them, and
+ * the panels are contiguous whatever the transposes and leading
+ * dimensions. Packing pads the panels with zeros, so the micro-kernel
+ * always computes a whole tile; a tile hanging over the edge of C is
+ * written through a buffer. A single column of C (a matrix-vector product)
+ * is not worth packing for, as every element of A is used once: it is
+ * computed straight from A, four columns of A or eight dot products at a
+ * time.
+ *
+ * With AVX and FMA the micro-kernels are 16 x 6 (float) and 8 x 6
+ * (double), twelve accumulating registers; otherwise 8 x 4 and 4 x 4
+ * loops the compiler can vectorize with SSE.
+ *
+ * gemmS and gemmD split C into one block of columns per POSIX thread, or
+ * of rows when C has few columns (a matrix-vector product), each a
+ * multiple of the tile; every thread packs into buffers of its own, so no
+ * thread waits on another until the join. As in BLAS, C is not read when
+ * beta is zero and op(A) op(B) is not computed when alpha is zero. They
+ * return 0, or -1 when out of memory.
+ */
+
+#if defined(__AVX__) && defined(__FMA__)
+#define GEMM_SMR    16
+#define GEMM_SNR    6
+#define GEMM_DMR    8
+#define GEMM_DNR    6
+#else
+#define GEMM_SMR    8
+#define GEMM_SNR    4
+#define GEMM_DMR    4
+#define GEMM_DNR    4
+#endif
+
+// block sizes: an A block of MC x KC is meant to fill about half of L2
+#ifndef GEMM_KC
+#define GEMM_KC     256
+#endif
+
+#ifndef GEMM_SMC
+#define GEMM_SMC    192
+#endif
+
+#ifndef GEMM_DMC
+#define GEMM_DMC    96
+#endif
+
+#ifndef GEMM_NC
+#define GEMM_NC     3072
+#endif
+
+// multiply-adds below which a thread is not worth starting
+#define GEMM_MIN_WORK   (64 * 64 * 64)
+
+#define GEMM_ALIGN  64
+
+/*
+ * One element type: its micro-kernel and packing routines and block
+ * sizes. The driver below works on bytes through this table, so it is
+ * written once for both types.
+ */
+typedef void (*GemmPack)(void *dst, const void *src, const int ld,
+                         const int trans, const int rows, const int cols,
+                         const int w);
+typedef void (*GemmKernel)(const int kc, const void *a, const void *b,
+                           void *c, const int ldc, const int mr,
+                           const int nr, const double alpha,
+                           const double beta);
+typedef void (*GemmScale)(void *c, const int ldc, const int m, const int n,
+                          const double beta);
+typedef void (*GemmColumn)(const int trans, const int m, const int k,
+                           const double alpha, const void *a, const int lda,
+                           const void *x, const int incx, const double beta,
+                           void *y);
+
+typedef struct
+{
+    int size;               // bytes per element
+    int mr, nr, mc, kc, nc;
+    GemmPack pack;
+    GemmKernel kernel;
+    GemmScale scale;
+    GemmColumn column;
+} GemmType;
+
+/*
+ * Pack the rows x cols block at src, element (i, p) of the operand being
+ * src[i + p * ld], or src[p + i * ld] when trans, into panels of w rows:
+ * panel r holds rows r * w .. r * w + w - 1, column p at p * w, padded
+ * with zeros past rows. A panels are packed as they are; B panels from
+ * the transpose of op(B), so that both are read w at a time along k.
+ */
+#define GEMM_PACK(name, T)                                                    \
+static inline void name(void *dst, const void *src, const int ld,            \
+                        const int trans, const int rows, const int cols,     \
+                        const int w)                                          \
+{                                                                             \
+    T *d = (T *)dst;                                                          \
+    const T *s = (const T *)src;                                              \
+                                                                              \
+    for (int r = 0; r < rows; r += w)                                         \
+    {                                                                         \
+        const int h = rows - r < w ? rows - r : w;                            \
+                                                                              \
+        if (!trans)                                                           \
+        {                                                                     \
+            for (int p = 0; p < cols; p++, d += w)                            \
+            {                                                                 \
+                const T *col = s + r + (size_t)p * ld;                        \
+                int i = 0;                                                    \
+                                                                              \
+                for (; i < h; i++) d[i] = col[i];                             \
+                                                                              \
+                for (; i < w; i++) d[i] = 0;                                  \
+            }                                                                 \
+        }                                                                     \
+        else                                                                  \
+        {                                                                     \
+            for (int i = 0; i < w; i++)                                       \
+            {                                                                 \
+                if (i < h)                                                    \
+                {                                                             \
+                    const T *row = s + (size_t)(r + i) * ld;                  \
+                                                                              \
+                    for (int p = 0; p < cols; p++) d[p * w + i] = row[p];     \
+                }                                                             \
+                else                                                          \
+                    for (int p = 0; p < cols; p++) d[p * w + i] = 0;          \
+            }                                                                 \
+                                                                              \
+            d += (size_t)cols * w;                                            \
+        }                                                                     \
+    }                                                                         \
+}
+
+GEMM_PACK(gemmPackS, float)
+GEMM_PACK(gemmPackD, double)
+
+/*
+ * C = alpha * acc + beta * C over the mr x nr corner of an MR x NR tile
+ * stored column by column; C is not read when beta is zero.
+ */
+#define GEMM_STORE(name, T)                                                   \
+static inline void name(const T *acc, const int MR, T *c, const int ldc,     \
+                        const int mr, const int nr, const T alpha,            \
+                        const T beta)                                         \
+{                                                                             \
+    for (int j = 0; j < nr; j++)                                              \
+    {                                                                         \
+        T *cj = c + (size_t)j * ldc;                                          \
+                                                                              \
+        if (beta == 0)                                                        \
+            for (int i = 0; i < mr; i++) cj[i] = alpha * acc[j * MR + i];     \
+        else                                                                  \
+            for (int i = 0; i < mr; i++)                                      \
+                cj[i] = alpha * acc[j * MR + i] + beta * cj[i];               \
+    }                                                                         \
+}
+
+GEMM_STORE(gemmStoreS, float)
+GEMM_STORE(gemmStoreD, double)
+
+#define GEMM_SCALE(name, T)                                                   \
+static inline void name(void *c, const int ldc, const int m, const int n,    \
+                        const double beta)                                    \
+{                                                                             \
+    for (int j = 0; j < n; j++)                                               \
+    {                                                                         \
+        T *cj = (T *)c + (size_t)j * ldc;                                     \
+                                                                              \
+        if (beta == 0.0)                                                      \
+            for (int i = 0; i < m; i++) cj[i] = 0;                            \
+        else                                                                  \
+            for (int i = 0; i < m; i++) cj[i] *= (T)beta;                     \
+    }                                                                         \
+}
+
+GEMM_SCALE(gemmScaleS, float)
+GEMM_SCALE(gemmScaleD, double)
+
+/*
+ * y = alpha * op(A) * x + beta * y, op(A) m x k, x with stride incx. A is
+ * read once: without trans as axpys of four columns per pass over y, with
+ * trans as dot products down its columns in eight partial sums.
+ */
+#define GEMM_COLUMN(name, T)                                                  \
+static inline void name(const int trans, const int m, const int k,           \
+                        const double alpha, const void *a, const int lda,     \
+                        const void *x, const int incx, const double beta,     \
+                        void *y)                                              \
+{                                                                             \
+    const T *A = (const T *)a, *X = (const T *)x;                             \
+    T *Y = (T *)y;                                                            \
+                                                                              \
+    if (!trans)                                                               \
+    {                                                                         \
+        int p = 0;                                                            \
+                                                                              \
+        for (int i = 0; i < m; i++) Y[i] = beta == 0.0 ? 0 : (T)beta * Y[i]; \
+                                                                              \
+        for (; p + 4 <= k; p += 4)                                            \
+        {                                                                     \
+            const T *a0 = A + (size_t)p * lda, *a1 = a0 + lda;                \
+            const T *a2 = a1 + lda, *a3 = a2 + lda;                           \
+            const T x0 = (T)alpha * X[(size_t)p * incx];                      \
+            const T x1 = (T)alpha * X[(size_t)(p + 1) * incx];                \
+            const T x2 = (T)alpha * X[(size_t)(p + 2) * incx];                \
+            const T x3 = (T)alpha * X[(size_t)(p + 3) * incx];                \
+                                                                              \
+            for (int i = 0; i < m; i++)                                       \
+                Y[i] += x0 * a0[i] + x1 * a1[i] + x2 * a2[i] + x3 * a3[i];    \
+        }                                                                     \
+                                                                              \
+        for (; p < k; p++)                                                    \
+        {                                                                     \
+            const T *ap = A + (size_t)p * lda;                                \
+            const T xp = (T)alpha * X[(size_t)p * incx];                      \
+                                                                              \
+            for (int i = 0; i < m; i++) Y[i] += xp * ap[i];                   \
+        }                                                                     \
+    }                                                                         \
+    else                                                                      \
+    {                                                                         \
+        for (int i = 0; i < m; i++)                                           \
+        {                                                                     \
+            const T *ai = A + (size_t)i * lda;                                \
+            T part[8] = { 0 }, sum = 0;                                       \
+            int p = 0;                                                        \
+                                                                              \
+            if (incx == 1)                                                    \
+                for (; p + 8 <= k; p += 8)                                    \
+                    for (int l = 0; l < 8; l++)                               \
+                        part[l] += ai[p + l] * X[p + l];                      \
+                                                                              \
+            for (; p < k; p++) sum += ai[p] * X[(size_t)p * incx];            \
+                                                                              \
+            for (int l = 0; l < 8; l++) sum += part[l];                       \
+                                                                              \
+            Y[i] = beta == 0.0 ? (T)alpha * sum :                             \
+                   (T)alpha * sum + (T)beta * Y[i];                           \
+        }                                                                     \
+    }                                                                         \
+}
+
+GEMM_COLUMN(gemmColumnS, float)
+GEMM_COLUMN(gemmColumnD, double)
+
+#if defined(__AVX__) && defined(__FMA__)
+
+/*
+ * The tile is NR columns of two AVX registers each. Every k loads one
+ * column of the A panel (two registers) and broadcasts the NR entries of
+ * the B panel in turn: 2 * NR fused multiply-adds per 2 loads.
+ */
+static inline void gemmKernelS(const int kc, const void *a, const void *b,
+                               void *c, const int ldc, const int mr,
+                               const int nr, const double alpha,
+                               const double beta)
+{
+    const float *pa = (const float *)a, *pb = (const float *)b;
+    float *pc = (float *)c;
+    __m256 acc[GEMM_SNR][2];
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < GEMM_SNR; j++)
+        acc[j][0] = acc[j][1] = _mm256_setzero_ps();
+
+    for (int p = 0; p < kc; p++, pa += GEMM_SMR, pb += GEMM_SNR)
+    {
+        const __m256 a0 = _mm256_load_ps(pa);
+        const __m256 a1 = _mm256_load_ps(pa + 8);
+
+        #pragma GCC unroll 6
+        for (int j = 0; j < GEMM_SNR; j++)
+        {
+            const __m256 bj = _mm256_broadcast_ss(pb + j);
+            acc[j][0] = _mm256_fmadd_ps(a0, bj, acc[j][0]);
+            acc[j][1] = _mm256_fmadd_ps(a1, bj, acc[j][1]);
+        }
+    }
+
+    if (mr == GEMM_SMR && nr == GEMM_SNR)
+    {
+        const __m256 va = _mm256_set1_ps((float)alpha);
+        const __m256 vb = _mm256_set1_ps((float)beta);
+
+        #pragma GCC unroll 6
+        for (int j = 0; j < GEMM_SNR; j++)
+        {
+            float *cj = pc + (size_t)j * ldc;
+            __m256 c0 = _mm256_mul_ps(va, acc[j][0]);
+            __m256 c1 = _mm256_mul_ps(va, acc[j][1]);
+
+            if (beta != 0.0)
+            {
+                c0 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(cj), c0);
+                c1 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(cj + 8), c1);
+            }
+
+            _mm256_storeu_ps(cj, c0);
+            _mm256_storeu_ps(cj + 8, c1);
+        }
+    }
+    else
+    {
+        float tile[GEMM_SMR * GEMM_SNR] __attribute__((aligned(32)));
+
+        // unrolled, so that acc stays in registers
+        #pragma GCC unroll 6
+        for (int j = 0; j < GEMM_SNR; j++)
+        {
+            _mm256_store_ps(tile + j * GEMM_SMR, acc[j][0]);
+            _mm256_store_ps(tile + j * GEMM_SMR + 8, acc[j][1]);
+        }
+
+        gemmStoreS(tile, GEMM_SMR, pc, ldc, mr, nr, (float)alpha,
+                   (float)beta);
+    }
+}
+
+static inline void gemmKernelD(const int kc, const void *a, const void *b,
+                               void *c, const int ldc, const int mr,
+                               const int nr, const double alpha,
+                               const double beta)
+{
+    const double *pa = (const double *)a, *pb = (const double *)b;
+    double *pc = (double *)c;
+    __m256d acc[GEMM_DNR][2];
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < GEMM_DNR; j++)
+        acc[j][0] = acc[j][1] = _mm256_setzero_pd();
+
+    for (int p = 0; p < kc; p++, pa += GEMM_DMR, pb += GEMM_DNR)
+    {
+        const __m256d a0 = _mm256_load_pd(pa);
+        const __m256d a1 = _mm256_load_pd(pa + 4);
+
+        #pragma GCC unroll 6
+        for (int j = 0; j < GEMM_DNR; j++)
+        {
+            const __m256d bj = _mm256_broadcast_sd(pb + j);
+            acc[j][0] = _mm256_fmadd_pd(a0, bj, acc[j][0]);
+            acc[j][1] = _mm256_fmadd_pd(a1, bj, acc[j][1]);
+        }
+    }
+
+    if (mr == GEMM_DMR && nr == GEMM_DNR)
+    {
+        const __m256d va = _mm256_set1_pd(alpha);
+        const __m256d vb = _mm256_set1_pd(beta);
+
+        #pragma GCC unroll 6
+        for (int j = 0; j < GEMM_DNR; j++)
+        {
+            double *cj = pc + (size_t)j * ldc;
+            __m256d c0 = _mm256_mul_pd(va, acc[j][0]);
+            __m256d c1 = _mm256_mul_pd(va, acc[j][1]);
+
+            if (beta != 0.0)
+            {
+                c0 = _mm256_fmadd_pd(vb, _mm256_loadu_pd(cj), c0);
+                c1 = _mm256_fmadd_pd(vb, _mm256_loadu_pd(cj + 4), c1);
+            }
+
+            _mm256_storeu_pd(cj, c0);
+            _mm256_storeu_pd(cj + 4, c1);
+        }
+    }
+    else
+    {
+        double tile[GEMM_DMR * GEMM_DNR] __attribute__((aligned(32)));
+
+        // unrolled, so that acc stays in registers
+        #pragma GCC unroll 6
+        for (int j = 0; j < GEMM_DNR; j++)
+        {
+            _mm256_store_pd(tile + j * GEMM_DMR, acc[j][0]);
+            _mm256_store_pd(tile + j * GEMM_DMR + 4, acc[j][1]);
+        }
+
+        gemmStoreD(tile, GEMM_DMR, pc, ldc, mr, nr, alpha, beta);
+    }
+}
+
+#else
+
+// the tile as an array; the i loops are there for the vectorizer
+#define GEMM_KERNEL(name, T, MR, NR, store)                                   \
+static inline void name(const int kc, const void *a, const void *b,          \
+                        void *c, const int ldc, const int mr, const int nr,   \
+                        const double alpha, const double beta)                \
+{                                                                             \
+    const T *pa = (const T *)a, *pb = (const T *)b;                           \
+    T acc[MR * NR];                                                           \
+                                                                              \
+    for (int i = 0; i < MR * NR; i++) acc[i] = 0;                             \
+                                                                              \
+    for (int p = 0; p < kc; p++, pa += MR, pb += NR)                          \
+    {                                                                         \
+        _Pragma("GCC unroll 4")                                               \
+        for (int j = 0; j < NR; j++)                                          \
+            for (int i = 0; i < MR; i++) acc[j * MR + i] += pa[i] * pb[j];    \
+    }                                                                         \
+                                                                              \
+    store(acc, MR, (T *)c, ldc, mr, nr, (T)alpha, (T)beta);                   \
+}
+
+GEMM_KERNEL(gemmKernelS, float, GEMM_SMR, GEMM_SNR, gemmStoreS)
+GEMM_KERNEL(gemmKernelD, double, GEMM_DMR, GEMM_DNR, gemmStoreD)
+
+#endif
+
+static const GemmType gemmTypeS = { sizeof(float), GEMM_SMR, GEMM_SNR,
+                                    GEMM_SMC, GEMM_KC, GEMM_NC, gemmPackS,
+                                    gemmKernelS, gemmScaleS, gemmColumnS
+                                  };
+
+static const GemmType gemmTypeD = { sizeof(double), GEMM_DMR, GEMM_DNR,
+                                    GEMM_DMC, GEMM_KC, GEMM_NC, gemmPackD,
+                                    gemmKernelD, gemmScaleD, gemmColumnD
+                                  };
+
+// one call's arguments, and the block of C one thread computes
+typedef struct
+{
+    const GemmType *t;
+    int transa, transb;
+    int m, n, k;
+    double alpha, beta;
+    const char *A, *B;
+    char *C;
+    int lda, ldb, ldc;
+    int status;
+} GemmJob;
+
+/*
+ * The five loops over one block of C, with this thread's packing buffers:
+ * jc over NC columns, pc over KC of k, ic over MC rows, then the tiles.
+ * beta applies on the first pass over k only; the later ones accumulate.
+ */
+static inline void *gemmBlocked(void *arg)
+{
+    GemmJob *g = (GemmJob *)arg;
+    const GemmType *t = g->t;
+    const int mr = t->mr, nr = t->nr, sz = t->size;
+    const int mc = g->m < t->mc ? (g->m + mr - 1) / mr * mr : t->mc;
+    const int kc = g->k < t->kc ? g->k : t->kc;
+    const int nc = g->n < t->nc ? (g->n + nr - 1) / nr * nr : t->nc;
+    void *pa = NULL, *pb = NULL;
+
+    if (g->n == 1)
+    {
+        t->column(g->transa, g->m, g->k, g->alpha, g->A, g->lda, g->B,
+                  g->transb ? g->ldb : 1, g->beta, g->C);
+        g->status = 0;
+        return NULL;
+    }
+
+    if (posix_memalign(&pa, GEMM_ALIGN, (size_t)mc * kc * sz) != 0 ||
+        posix_memalign(&pb, GEMM_ALIGN, (size_t)nc * kc * sz) != 0)
+    {
+        free(pa);
+        g->status = -1;
+        return NULL;
+    }
+
+    for (int jc = 0; jc < g->n; jc += nc)
+    {
+        const int nb = g->n - jc < nc ? g->n - jc : nc;
+
+        for (int pc = 0; pc < g->k; pc += kc)
+        {
+            const int kb = g->k - pc < kc ? g->k - pc : kc;
+            const double beta = pc == 0 ? g->beta : 1.0;
+
+            // op(B)(pc.., jc..) transposed, so element (j, p)
+            const char *b = g->transb ?
+                            g->B + ((size_t)pc * g->ldb + jc) * sz :
+                            g->B + ((size_t)jc * g->ldb + pc) * sz;
+            t->pack(pb, b, g->ldb, !g->transb, nb, kb, nr);
+
+            for (int ic = 0; ic < g->m; ic += mc)
+            {
+                const int mb = g->m - ic < mc ? g->m - ic : mc;
+                const char *a = g->transa ?
+                                g->A + ((size_t)ic * g->lda + pc) * sz :
+                                g->A + ((size_t)pc * g->lda + ic) * sz;
+                t->pack(pa, a, g->lda, g->transa, mb, kb, mr);
+
+                for (int jr = 0; jr < nb; jr += nr)
+                {
+                    for (int ir = 0; ir < mb; ir += mr)
+                    {
+                        char *c = g->C + ((size_t)(jc + jr) * g->ldc + ic +
+                                          ir) * sz;
+                        t->kernel(kb, (char *)pa + (size_t)ir * kb * sz,
+                                  (char *)pb + (size_t)jr * kb * sz, c,
+                                  g->ldc, mb - ir < mr ? mb - ir : mr,
+                                  nb - jr < nr ? nb - jr : nr, g->alpha,
+                                  beta);
+                    }
+                }
+            }
+        }
+    }
+
+    free(pa);
+    free(pb);
+    g->status = 0;
+    return NULL;
+}
+
+/*
+ * Split C over nthreads, fewer when the product is small, and run
+ * gemmBlocked on every part. Parts are whole tiles: columns in multiples
+ * of NR when C is wider than it is tall over the tile shape, else rows in
+ * multiples of MR. A part whose thread cannot be started runs here.
+ */
+static inline int gemmRun(const GemmType *t, const char transa,
+                          const char transb, const int m, const int n,
+                          const int k, const double alpha, const void *A,
+                          const int lda, const void *B, const int ldb,
+                          const double beta, void *C, const int ldc,
+                          int nthreads)
+{
+    GemmJob g;
+
+    if (m <= 0 || n <= 0) return 0;
+
+    if (alpha == 0.0 || k <= 0)
+    {
+        if (beta != 1.0) t->scale(C, ldc, m, n, beta);
+
+        return 0;
+    }
+
+    g.t = t;
+    g.transa = transa != 'N' && transa != 'n';
+    g.transb = transb != 'N' && transb != 'n';
+    g.m = m;
+    g.n = n;
+    g.k = k;
+    g.alpha = alpha;
+    g.beta = beta;
+    g.A = (const char *)A;
+    g.B = (const char *)B;
+    g.C = (char *)C;
+    g.lda = lda;
+    g.ldb = ldb;
+    g.ldc = ldc;
+
+    const double work = (double)m * n * k;
+
+    if (nthreads > work / GEMM_MIN_WORK) nthreads = (int)(work / GEMM_MIN_WORK);
+
+    const int byCols = n / t->nr >= m / t->mr;
+    const int tiles = byCols ? (n + t->nr - 1) / t->nr :
+                      (m + t->mr - 1) / t->mr;
+
+    if (nthreads > tiles) nthreads = tiles;
+
+    if (nthreads <= 1)
+    {
+        gemmBlocked(&g);
+        return g.status;
+    }
+
+    pthread_t *tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    GemmJob *job = (GemmJob *)malloc(nthreads * sizeof(GemmJob));
+
+    if (tid == NULL || job == NULL)
+    {
+        free(tid);
+        free(job);
+        return -1;
+    }
+
+    int nstarted = 1;
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        const int t0 = (int)((long)tiles * i / nthreads);
+        const int t1 = (int)((long)tiles * (i + 1) / nthreads);
+
+        job[i] = g;
+
+        if (byCols)
+        {
+            const int j0 = t0 * t->nr, j1 = t1 * t->nr < n ? t1 * t->nr : n;
+
+            job[i].n = j1 - j0;
+            job[i].B = g.B + (g.transb ? (size_t)j0 :
+                              (size_t)j0 * ldb) * t->size;
+            job[i].C = g.C + (size_t)j0 * ldc * t->size;
+        }
+        else
+        {
+            const int i0 = t0 * t->mr, i1 = t1 * t->mr < m ? t1 * t->mr : m;
+
+            job[i].m = i1 - i0;
+            job[i].A = g.A + (g.transa ? (size_t)i0 * lda :
+                              (size_t)i0) * t->size;
+            job[i].C = g.C + (size_t)i0 * t->size;
+        }
+
+        // none started after the first that fails
+        if (i > 0 && nstarted == i &&
+                pthread_create(&tid[i], NULL, gemmBlocked, &job[i]) == 0)
+            nstarted++;
+    }
+
+    // the tiles of the threads not started, here
+    for (int i = 0; i < nthreads; i++)
+        if (i == 0 || i >= nstarted) gemmBlocked(&job[i]);
+
+    int status = 0;
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        if (i > 0 && i < nstarted) pthread_join(tid[i], NULL);
+
+        if (job[i].status != 0) status = job[i].status;
+    }
+
+    free(tid);
+    free(job);
+    return status;
+}
+
+static inline int gemmS(const char transa, const char transb, const int m,
+                        const int n, const int k, const float alpha,
+                        const float *A, const int lda, const float *B,
+                        const int ldb, const float beta, float *C,
+                        const int ldc, const int nthreads)
+{
+    return gemmRun(&gemmTypeS, transa, transb, m, n, k, alpha, A, lda, B,
+                   ldb, beta, C, ldc, nthreads);
+}
+
+static inline int gemmD(const char transa, const char transb, const int m,
+                        const int n, const int k, const double alpha,
+                        const double *A, const int lda, const double *B,
+                        const int ldb, const double beta, double *C,
+                        const int ldc, const int nthreads)
+{
+    return gemmRun(&gemmTypeD, transa, transb, m, n, k, alpha, A, lda, B,
+                   ldb, beta, C, ldc, nthreads);
+}
+
+#endif // _GEMM_H
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef _HOSTMEM_H
+#define _HOSTMEM_H
+
+/*
+ * Host allocator with reuse pools, for the buffers the samples take with
+ * malloc or cudaMallocHost and give back again and again (staging buffers,
+ * per-chunk buffers, snapshots).
+ *
+ * hostAlloc rounds a request up to a size class: multiples of 64 bytes up
+ * to 256, then four classes per power of two, so a block wastes at most a
+ * quarter of its size. A freed block goes on the free list of its class and
+ * the next request of that class takes it back without a system call and
+ * without faulting its pages in again. The pools keep up to HOST_POOL_MAX
+ * bytes; beyond that, and on hostTrim, blocks go back to the system.
+ *
+ * Every block is HOST_ALIGN (a cache line, and an AVX-512 vector) aligned.
+ * Blocks of HOST_HUGE bytes and more are mapped on their own, rounded up to
+ * and aligned on huge-page boundaries, and advised for transparent huge
+ * pages, so a large buffer costs one TLB entry per 2 MB.
+ *
+ *   HOST_LOCKED   the pages are locked in memory with mlock, the host side
+ *                 of what cudaMallocHost does: they are resident and never
+ *                 swapped. Locked and unlocked blocks are pooled apart. When
+ *                 the lock is refused (RLIMIT_MEMLOCK) the block is handed
+ *                 out unlocked and the failure counted.
+ *   HOST_TOUCH    a new mapped block is faulted in at once by hostTouch,
+ *                 split in contiguous parts over one thread per processor.
+ *                 Under the first-touch policy each page is placed on the
+ *                 NUMA node of the thread that touches it first, so a
+ *                 buffer later worked on in the same static split by the
+ *                 same number of threads is local to them; on one node it
+ *                 moves the page faults out of the first use.
+ *
+ * The header of a block sits in the HOST_ALIGN bytes before it (before the
+ * huge-page boundary for a mapped block), so hostFree needs no size. The
+ * pools are shared by all threads behind one lock; hostStats returns the
+ * counters, and hostPrintStats prints them.
+ *
+ * hostAlloc returns NULL when out of memory; the contents of a block are
+ * undefined, as with malloc. Under -std=c99 the including file defines
+ * _GNU_SOURCE, for posix_memalign and MAP_ANONYMOUS.
+ */
+
+#define HOST_ALIGN      64
+
+// blocks of this size and more are mapped on huge-page boundaries
+#define HOST_HUGE       (2 << 20)
+
+// bytes kept in the pools
+#ifndef HOST_POOL_MAX
+#define HOST_POOL_MAX   ((size_t)256 << 20)
+#endif
+
+// 4 classes to 256 bytes, then 4 per power of two to 2^48
+#define HOST_CLASSES    164
+
+#define HOST_LOCKED     1
+#define HOST_TOUCH      2
+
+#define HOST_MAGIC      0x686f7374u
+
+typedef struct HostBlock
+{
+    struct HostBlock *next; // in a free list
+    size_t size;            // usable bytes
+    size_t mapLen;          // bytes mapped from map, 0 for the heap
+    void *map;
+    int cls;
+    int locked;
+    unsigned magic;
+} HostBlock;
+
+typedef struct
+{
+    long nalloc, nfree;     // calls
+    long nhit, nmiss;       // allocations served by the pools, and not
+    long nrelease;          // blocks given back to the system
+    long nlockFail;         // HOST_LOCKED blocks that could not be locked
+    size_t inUse, peak;     // bytes handed out, now and at most
+    size_t cached;          // bytes in the pools
+    size_t reserved;        // bytes taken from the system
+    size_t locked;          // of those, locked
+} HostStats;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    HostBlock *free[2][HOST_CLASSES];   // unlocked, locked
+    HostStats stats;
+} HostPool;
+
+static HostPool hostPool = { PTHREAD_MUTEX_INITIALIZER, {{NULL}}, {0} };
+
+// the size class of size bytes, or -1 when too large
+static inline int hostClass(size_t size)
+{
+    if (size <= 256) return size == 0 ? 0 : (int)((size - 1) >> 6);
+
+    const int k = 63 - __builtin_clzll((unsigned long long)(size - 1));
+    const int m = (int)((size - 1) >> (k - 2)) + 1;
+
+    return k >= 48 ? -1 : 4 + (k - 8) * 4 + (m - 5);
+}
+
+static inline size_t hostClassSize(const int cls)
+{
+    if (cls < 4) return (size_t)(cls + 1) << 6;
+
+    const int k = 8 + (cls - 4) / 4;
+
+    return (size_t)(5 + (cls - 4) % 4) << (k - 2);
+}
+
+typedef struct
+{
+    char *p;
+    size_t len, page;
+    int started;
+} HostTouch;
+
+static inline void *hostTouchRun(void *arg)
+{
+    HostTouch *t = (HostTouch *)arg;
+
+    for (size_t i = 0; i < t->len; i += t->page)
+        ((volatile char *)t->p)[i] = 0;
+
+    return NULL;
+}
+
+/*
+ * Write one byte of every page of p in nthreads contiguous parts, one per
+ * thread (nthreads < 1 is one per processor), so that each page is placed
+ * by the thread of its part. The bytes written are zero.
+ */
+static inline void hostTouch(void *p, const size_t size, int nthreads)
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t npage = (size + page - 1) / page;
+
+    if (nthreads < 1) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if ((size_t)nthreads > size / HOST_HUGE)
+        nthreads = (int)(size / HOST_HUGE);
+
+    if (nthreads < 1) nthreads = 1;
+
+    HostTouch *job = (HostTouch *)malloc(nthreads * sizeof(HostTouch));
+    pthread_t *tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+
+    if (job == NULL || tid == NULL)
+    {
+        HostTouch t = { (char *)p, size, page, 0 };
+        hostTouchRun(&t);
+        free(job);
+        free(tid);
+        return;
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        // parts on page boundaries
+        size_t lo = npage * i / nthreads * page;
+        size_t hi = npage * (i + 1) / nthreads * page;
+
+        job[i].p = (char *)p + lo;
+        job[i].len = (hi < size ? hi : size) - lo;
+        job[i].page = page;
+        job[i].started = i > 0 &&
+                         pthread_create(tid + i, NULL, hostTouchRun,
+                                        job + i) == 0;
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        if (job[i].started)
+            pthread_join(tid[i], NULL);
+        else
+            hostTouchRun(job + i);
+    }
+
+    free(job);
+    free(tid);
+}
+
+// a new block of class cls from the system
+static inline HostBlock *hostReserve(const int cls)
+{
+    const size_t size = hostClassSize(cls);
+    HostBlock *b;
+    void *map = NULL;
+    size_t mapLen = 0, usable = size;
+
+    if (size < HOST_HUGE)
+    {
+        if (posix_memalign(&map, HOST_ALIGN, HOST_ALIGN + size) != 0)
+            return NULL;
+
+        b = (HostBlock *)map;
+    }
+    else
+    {
+        // the header on the page before a huge-page boundary
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        usable = (size + HOST_HUGE - 1) / HOST_HUGE * HOST_HUGE;
+        const size_t len = usable + HOST_HUGE + page;
+
+        char *raw = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (raw == (char *)MAP_FAILED) return NULL;
+
+        char *data = (char *)(((uintptr_t)raw + page + HOST_HUGE - 1) &
+                              ~(uintptr_t)(HOST_HUGE - 1));
+        char *end = data + usable;
+
+        map = data - page;
+        mapLen = page + usable;
+
+        if ((char *)map > raw) munmap(raw, (char *)map - raw);
+
+        if (end < raw + len) munmap(end, raw + len - end);
+
+#if defined(MADV_HUGEPAGE)
+        madvise(data, usable, MADV_HUGEPAGE);
+#endif
+
+        b = (HostBlock *)(data - HOST_ALIGN);
+    }
+
+    b->next = NULL;
+    b->size = usable;
+    b->mapLen = mapLen;
+    b->map = map;
+    b->cls = cls;
+    b->locked = 0;
+    b->magic = HOST_MAGIC;
+
+    return b;
+}
+
+// give a block back to the system
+static inline void hostRelease(HostBlock *b)
+{
+    if (b->locked) munlock((char *)b + HOST_ALIGN, b->size);
+
+    if (b->mapLen != 0)
+        munmap(b->map, b->mapLen);
+    else
+        free(b->map);
+}
+
+static inline void *hostAlloc(const size_t size, const int flags)
+{
+    const int cls = hostClass(size);
+    const int locked = (flags & HOST_LOCKED) != 0;
+    HostPool *h = &hostPool;
+
+    if (cls < 0) return NULL;
+
+    pthread_mutex_lock(&h->lock);
+    HostBlock *b = h->free[locked][cls];
+
+    if (b != NULL)
+    {
+        h->free[locked][cls] = b->next;
+        h->stats.cached -= b->size;
+        h->stats.nhit++;
+    }
+    else
+    {
+        h->stats.nmiss++;
+    }
+
+    pthread_mutex_unlock(&h->lock);
+
+    if (b == NULL)
+    {
+        if ((b = hostReserve(cls)) == NULL) return NULL;
+
+        if (locked && mlock((char *)b + HOST_ALIGN, b->size) == 0)
+            b->locked = 1;
+
+        if ((flags & HOST_TOUCH) && b->mapLen != 0)
+            hostTouch((char *)b + HOST_ALIGN, b->size, 0);
+
+        pthread_mutex_lock(&h->lock);
+        h->stats.reserved += b->size;
+
+        if (b->locked)
+            h->stats.locked += b->size;
+        else if (locked)
+            h->stats.nlockFail++;
+    }
+    else
+    {
+        pthread_mutex_lock(&h->lock);
+    }
+
+    b->next = NULL;
+    h->stats.nalloc++;
+    h->stats.inUse += b->size;
+
+    if (h->stats.inUse > h->stats.peak) h->stats.peak = h->stats.inUse;
+
+    pthread_mutex_unlock(&h->lock);
+
+    return (char *)b + HOST_ALIGN;
+}
+
+static inline void hostFree(void *p)
+{
+    HostPool *h = &hostPool;
+
+    if (p == NULL) return;
+
+    HostBlock *b = (HostBlock *)((char *)p - HOST_ALIGN);
+
+    if (b->magic != HOST_MAGIC)
+    {
+        fprintf(stderr, "hostFree: %p was not allocated by hostAlloc\n", p);
+        abort();
+    }
+
+    pthread_mutex_lock(&h->lock);
+    h->stats.nfree++;
+    h->stats.inUse -= b->size;
+
+    if (h->stats.cached + b->size <= HOST_POOL_MAX)
+    {
+        b->next = h->free[b->locked][b->cls];
+        h->free[b->locked][b->cls] = b;
+        h->stats.cached += b->size;
+        b = NULL;
+    }
+    else
+    {
+        h->stats.nrelease++;
+        h->stats.reserved -= b->size;
+
+        if (b->locked) h->stats.locked -= b->size;
+    }
+
+    pthread_mutex_unlock(&h->lock);
+
+    if (b != NULL) hostRelease(b);
+}
+
+// malloc and free signatures, e.g. for the staging buffers of snapOpen
+static inline void *hostMalloc(size_t size)
+{
+    return hostAlloc(size, 0);
+}
+
+static inline void *hostMallocLocked(size_t size)
+{
+    return hostAlloc(size, HOST_LOCKED);
+}
+
+// give every pooled block back to the system
+static inline void hostTrim(void)
+{
+    HostPool *h = &hostPool;
+    HostBlock *list = NULL;
+
+    pthread_mutex_lock(&h->lock);
+
+    for (int l = 0; l < 2; l++)
+    {
+        for (int c = 0; c < HOST_CLASSES; c++)
+        {
+            while (h->free[l][c] != NULL)
+            {
+                HostBlock *b = h->free[l][c];
+                h->free[l][c] = b->next;
+                b->next = list;
+                list = b;
+                h->stats.nrelease++;
+                h->stats.reserved -= b->size;
+
+                if (b->locked) h->stats.locked -= b->size;
+            }
+        }
+    }
+
+    h->stats.cached = 0;
+    pthread_mutex_unlock(&h->lock);
+
+    while (list != NULL)
+    {
+        HostBlock *b = list;
+        list = b->next;
+        hostRelease(b);
+    }
+}
+
+static inline void hostStats(HostStats *s)
+{
+    pthread_mutex_lock(&hostPool.lock);
+    *s = hostPool.stats;
+    pthread_mutex_unlock(&hostPool.lock);
+}
+
+static inline void hostPrintStats(const char *name)
+{
+    HostStats s;
+    const double mb = 1.0 / (1024.0 * 1024.0);
+
+    hostStats(&s);
+    printf("%s: %ld allocations, %ld from the pools (%.1f%%), %ld frees, "
+           "%ld released\n", name, s.nalloc, s.nhit,
+           s.nalloc ? 100.0 * s.nhit / s.nalloc : 0.0, s.nfree, s.nrelease);
+    printf("%s: %.2f MB in use (peak %.2f MB), %.2f MB pooled, %.2f MB "
+           "reserved, %.2f MB locked", name, s.inUse * mb, s.peak * mb,
+           s.cached * mb, s.reserved * mb, s.locked * mb);
+
+    if (s.nlockFail) printf(", %ld locks refused", s.nlockFail);
+
+    printf("\n");
+    fflush(stdout);
+}
+
+#endif // _HOSTMEM_H
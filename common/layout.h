@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef _LAYOUT_H
+#define _LAYOUT_H
+
+/*
+ * Storage layouts for arrays of records, the choice simpleMathAoS.cu and
+ * simpleMathSoA.cu hand-code as innerStruct and innerArray. The record is
+ * described once, as a plain struct plus its field list:
+ *
+ *     struct innerStruct { float x; float y; };
+ *     LAYOUT_RECORD(innerStruct, LAYOUT_FIELD(innerStruct, x),
+ *                                LAYOUT_FIELD(innerStruct, y))
+ *
+ * and the same n records can then be stored as
+ *
+ *     AoS<innerStruct>        x0 y0 x1 y1 x2 y2 ...
+ *     SoA<innerStruct>        x0 x1 x2 ... y0 y1 y2 ...
+ *     AoSoA<innerStruct, W>   x0 .. x(W-1) y0 .. y(W-1) xW .. x(2W-1) ...
+ *
+ * All three have the same accessors, one field by member pointer or the
+ * whole record:
+ *
+ *     C.at(&innerStruct::x, i) = A.at(&innerStruct::x, i) + 10.f;
+ *     innerStruct r = A.get(i);
+ *
+ * so a kernel written once as a template over the layout runs on each. A
+ * field at byte offset o, of size s, in a record of size S lives at
+ *
+ *     AoS     i * S + o
+ *     SoA     n * o + i * s
+ *     AoSoA   (i / W) * W * S + W * o + (i % W) * s
+ *
+ * so each field of SoA is a plain array, and of AoSoA a run of W-wide
+ * tiles: what the compiler needs to vectorize a loop over one field, while
+ * AoSoA keeps all fields of a record within a few cache lines. Padding in
+ * the record is kept and only costs space.
+ *
+ * Indexing AoSoA one record at a time hides the tiles from the vectorizer,
+ * so loops that should vectorize go run by run: run(i) records from i on
+ * have each field step(m) elements apart (to the end for AoS and SoA, to
+ * the end of the tile for AoSoA).
+ *
+ *     for (size_t i = 0; i < n; i += A.run(i))
+ *     {
+ *         const size_t len = A.run(i), s = L::step(&innerStruct::x);
+ *         float *x = &A.at(&innerStruct::x, i);
+ *
+ *         for (size_t j = 0; j < len; j++) x[j * s] += 10.f;
+ *     }
+ */
+
+// alignment of every layout's storage, one cache line
+#define LAYOUT_ALIGN    64
+
+typedef struct
+{
+    size_t offset;
+    size_t size;
+} LayoutField;
+
+// the field list of a record, given by LAYOUT_RECORD
+template <typename R>
+struct LayoutRecord;
+
+#define LAYOUT_FIELD(R, m)  { offsetof(R, m), sizeof(((R *)0)->m) }
+
+#define LAYOUT_RECORD(R, ...)                                                  \
+template <>                                                                    \
+struct LayoutRecord<R>                                                         \
+{                                                                              \
+    static const LayoutField *fields(size_t *n)                                \
+    {                                                                          \
+        static const LayoutField f[] = { __VA_ARGS__ };                        \
+        *n = sizeof(f) / sizeof(f[0]);                                         \
+        return f;                                                              \
+    }                                                                          \
+};
+
+// byte offset of a member within its record
+template <typename R, typename T>
+inline size_t layoutOffset(T R::*m)
+{
+    static R probe;
+    return (size_t)((char *)&(probe.*m) - (char *)&probe);
+}
+
+/*
+ * Accessors shared by the layouts. L supplies addr(o, s, i), the address of
+ * the field at offset o and size s of record i.
+ */
+template <typename L, typename R>
+class LayoutBase
+{
+public:
+    explicit LayoutBase(size_t n, size_t bytes) : n_(n), bytes_(bytes)
+    {
+        if (posix_memalign((void **)&base_, LAYOUT_ALIGN,
+                           bytes ? bytes : LAYOUT_ALIGN) != 0)
+            base_ = NULL;
+        else
+            memset(base_, 0, bytes);
+    }
+
+    ~LayoutBase() { free(base_); }
+
+    size_t size() const { return n_; }
+    size_t bytes() const { return bytes_; }
+    bool valid() const { return base_ != NULL; }
+
+    template <typename T>
+    T &at(T R::*m, size_t i)
+    {
+        return *(T *)self().addr(layoutOffset(m), sizeof(T), i);
+    }
+
+    template <typename T>
+    const T &at(T R::*m, size_t i) const
+    {
+        return *(const T *)self().addr(layoutOffset(m), sizeof(T), i);
+    }
+
+    R get(size_t i) const
+    {
+        R r;
+        size_t nf;
+        const LayoutField *f = LayoutRecord<R>::fields(&nf);
+
+        for (size_t k = 0; k < nf; k++)
+        {
+            memcpy((char *)&r + f[k].offset,
+                   self().addr(f[k].offset, f[k].size, i), f[k].size);
+        }
+
+        return r;
+    }
+
+    void set(size_t i, const R &r)
+    {
+        size_t nf;
+        const LayoutField *f = LayoutRecord<R>::fields(&nf);
+
+        for (size_t k = 0; k < nf; k++)
+        {
+            memcpy(self().addr(f[k].offset, f[k].size, i),
+                   (const char *)&r + f[k].offset, f[k].size);
+        }
+    }
+
+protected:
+    const L &self() const { return *static_cast<const L *>(this); }
+
+    size_t n_;
+    size_t bytes_;
+    char *base_;
+
+private:
+    LayoutBase(const LayoutBase &);
+    LayoutBase &operator=(const LayoutBase &);
+};
+
+template <typename R>
+class AoS : public LayoutBase<AoS<R>, R>
+{
+public:
+    explicit AoS(size_t n) : LayoutBase<AoS<R>, R>(n, n * sizeof(R)) {}
+
+    static const char *name() { return "AoS      "; }
+
+    char *addr(size_t o, size_t, size_t i) const
+    {
+        return this->base_ + i * sizeof(R) + o;
+    }
+
+    size_t run(size_t i) const { return this->n_ - i; }
+
+    // in whole elements, so for fields whose size divides the record's
+    template <typename T>
+    static size_t step(T R::*) { return sizeof(R) / sizeof(T); }
+};
+
+template <typename R>
+class SoA : public LayoutBase<SoA<R>, R>
+{
+public:
+    explicit SoA(size_t n) : LayoutBase<SoA<R>, R>(n, n * sizeof(R)) {}
+
+    static const char *name() { return "SoA      "; }
+
+    char *addr(size_t o, size_t s, size_t i) const
+    {
+        return this->base_ + this->n_ * o + i * s;
+    }
+
+    size_t run(size_t i) const { return this->n_ - i; }
+
+    template <typename T>
+    static size_t step(T R::*) { return 1; }
+
+    // the plain array holding field m
+    template <typename T>
+    T *field(T R::*m)
+    {
+        return (T *)addr(layoutOffset(m), sizeof(T), 0);
+    }
+};
+
+// W records per tile; a multiple of the SIMD width, e.g. 8 floats for AVX
+template <typename R, size_t W>
+class AoSoA : public LayoutBase<AoSoA<R, W>, R>
+{
+public:
+    explicit AoSoA(size_t n) :
+        LayoutBase<AoSoA<R, W>, R>(n, (n + W - 1) / W * W * sizeof(R)) {}
+
+    static const char *name() { return W == 4 ? "AoSoA<4> " :
+                                       W == 8 ? "AoSoA<8> " :
+                                       W == 16 ? "AoSoA<16>" : "AoSoA<W> "; }
+
+    char *addr(size_t o, size_t s, size_t i) const
+    {
+        return this->base_ + (i / W) * W * sizeof(R) + W * o + (i % W) * s;
+    }
+
+    size_t run(size_t i) const
+    {
+        return W - i % W < this->n_ - i ? W - i % W : this->n_ - i;
+    }
+
+    template <typename T>
+    static size_t step(T R::*) { return 1; }
+};
+
+#endif // _LAYOUT_H
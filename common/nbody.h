@@ -0,0 +1,680 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#ifndef _NBODY_H
+#define _NBODY_H
+
+/*
+ * Host N-body engine for the simulation in 7tuning/nbody.cu. Include it
+ * after the real typedef: float with SINGLE_PREC, double otherwise.
+ *
+ * Each body gets the same acceleration as in h_nbody_update_velocity,
+ *
+ *     a_i = sum_j mass * r_ij / max(|r_ij|^2, limit)^(3/2),
+ *
+ * but
+ *
+ *  - every pair is visited once and applied to both bodies (Newton's third
+ *    law), which halves the work;
+ *  - the bodies are cut into NBODY_TILE tiles and the work is the upper
+ *    triangle of tile pairs (I, J), so the J tile being swept stays in L1;
+ *  - the j loop runs in AVX registers with a hardware rsqrt estimate and
+ *    Newton refinement (one step in single precision; in double the
+ *    estimate is taken in single precision and refined twice, to about
+ *    1e-13) in place of 1 / sqrt(d^6);
+ *  - tile pairs are shared out by OpenMP threads, each adding into its own
+ *    force buffer; the buffers are summed at the end, so no two threads
+ *    ever write to the same body.
+ *
+ * Without -fopenmp the engine runs on one thread; without AVX the j loop is
+ * scalar.
+ */
+
+// bodies per tile: positions and forces of a tile fit in L1
+#define NBODY_TILE  512
+
+typedef struct
+{
+    int N;
+    int nthreads;
+    real *fx, *fy;              // nthreads force buffers of N each
+} NBody;
+
+static inline int nbodyInit(NBody *nb, int N)
+{
+#ifdef _OPENMP
+    nb->nthreads = omp_get_max_threads();
+#else
+    nb->nthreads = 1;
+#endif
+    nb->N  = N;
+    nb->fx = (real *)malloc((size_t)nb->nthreads * N * sizeof(real));
+    nb->fy = (real *)malloc((size_t)nb->nthreads * N * sizeof(real));
+    return (nb->fx == NULL || nb->fy == NULL);
+}
+
+static inline void nbodyFree(NBody *nb)
+{
+    free(nb->fx);
+    free(nb->fy);
+}
+
+#if defined(__AVX__) && defined(SINGLE_PREC)
+
+#define NBODY_WIDTH 8
+typedef __m256 nbvec;
+#define nbSet1(x)       _mm256_set1_ps(x)
+#define nbLoad(p)       _mm256_loadu_ps(p)
+#define nbStore(p, v)   _mm256_storeu_ps(p, v)
+#define nbAdd(a, b)     _mm256_add_ps(a, b)
+#define nbSub(a, b)     _mm256_sub_ps(a, b)
+#define nbMul(a, b)     _mm256_mul_ps(a, b)
+#define nbMax(a, b)     _mm256_max_ps(a, b)
+
+// y ~ 1/sqrt(x) to 12 bits, then y * (1.5 - 0.5 * x * y * y)
+static inline nbvec nbRsqrt(nbvec x)
+{
+    nbvec y = _mm256_rsqrt_ps(x);
+    nbvec hx = _mm256_mul_ps(x, _mm256_set1_ps(0.5f));
+    nbvec t = _mm256_mul_ps(hx, _mm256_mul_ps(y, y));
+    return _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), t));
+}
+
+static inline real nbHsum(nbvec v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+#elif defined(__AVX__)
+
+#define NBODY_WIDTH 4
+typedef __m256d nbvec;
+#define nbSet1(x)       _mm256_set1_pd(x)
+#define nbLoad(p)       _mm256_loadu_pd(p)
+#define nbStore(p, v)   _mm256_storeu_pd(p, v)
+#define nbAdd(a, b)     _mm256_add_pd(a, b)
+#define nbSub(a, b)     _mm256_sub_pd(a, b)
+#define nbMul(a, b)     _mm256_mul_pd(a, b)
+#define nbMax(a, b)     _mm256_max_pd(a, b)
+
+// single-precision estimate, two Newton steps in double
+static inline nbvec nbRsqrt(nbvec x)
+{
+    nbvec y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(x)));
+    nbvec hx = _mm256_mul_pd(x, _mm256_set1_pd(0.5));
+    nbvec c = _mm256_set1_pd(1.5);
+
+    y = _mm256_mul_pd(y, _mm256_sub_pd(c, _mm256_mul_pd(hx,
+                      _mm256_mul_pd(y, y))));
+    y = _mm256_mul_pd(y, _mm256_sub_pd(c, _mm256_mul_pd(hx,
+                      _mm256_mul_pd(y, y))));
+    return y;
+}
+
+static inline real nbHsum(nbvec v)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v),
+                           _mm256_extractf128_pd(v, 1));
+    s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+    return _mm_cvtsd_f64(s);
+}
+
+#else
+
+#define NBODY_WIDTH 1
+
+#endif
+
+/*
+ * All pairs i < j with i in [i0, i1) and j in [j0, j1) (j > i on a diagonal
+ * tile). Forces on i are summed in registers and added to bx/by[i] once;
+ * the reactions go straight into bx/by[j], which stay in L1.
+ */
+static inline void nbodyTilePair(const real *px, const real *py, real *bx,
+                                 real *by, int i0, int i1, int j0, int j1,
+                                 real mass, real limit)
+{
+    for (int i = i0; i < i1; i++)
+    {
+        const real xi = px[i];
+        const real yi = py[i];
+        real axi = 0, ayi = 0;
+        int j = (j0 > i + 1) ? j0 : i + 1;
+
+#if NBODY_WIDTH > 1
+        nbvec vxi = nbSet1(xi), vyi = nbSet1(yi);
+        nbvec vmass = nbSet1(mass), vlimit = nbSet1(limit);
+        nbvec vax = nbSet1(0), vay = nbSet1(0);
+
+        for (; j + NBODY_WIDTH <= j1; j += NBODY_WIDTH)
+        {
+            nbvec rx = nbSub(nbLoad(px + j), vxi);
+            nbvec ry = nbSub(nbLoad(py + j), vyi);
+            nbvec d2 = nbMax(nbAdd(nbMul(rx, rx), nbMul(ry, ry)), vlimit);
+            nbvec r = nbRsqrt(d2);
+            nbvec s = nbMul(vmass, nbMul(r, nbMul(r, r)));
+            nbvec fx = nbMul(rx, s);
+            nbvec fy = nbMul(ry, s);
+            vax = nbAdd(vax, fx);
+            vay = nbAdd(vay, fy);
+            nbStore(bx + j, nbSub(nbLoad(bx + j), fx));
+            nbStore(by + j, nbSub(nbLoad(by + j), fy));
+        }
+
+        axi = nbHsum(vax);
+        ayi = nbHsum(vay);
+#endif
+
+        for (; j < j1; j++)
+        {
+            real rx = px[j] - xi;
+            real ry = py[j] - yi;
+            real d2 = rx * rx + ry * ry;
+
+            if (d2 < limit) d2 = limit;
+
+            real r = (real)(1.0 / sqrt(d2));
+            real s = mass * r * r * r;
+            axi += rx * s;
+            ayi += ry * s;
+            bx[j] -= rx * s;
+            by[j] -= ry * s;
+        }
+
+        bx[i] += axi;
+        by[i] += ayi;
+    }
+}
+
+// accelerations of all N bodies into ax, ay
+static inline void nbodyAccel(NBody *nb, const real *px, const real *py,
+                              real *ax, real *ay, real mass, real limit)
+{
+    const int N = nb->N;
+    const int nt = (N + NBODY_TILE - 1) / NBODY_TILE;
+
+    #pragma omp parallel num_threads(nb->nthreads)
+    {
+#ifdef _OPENMP
+        const int tid = omp_get_thread_num();
+#else
+        const int tid = 0;
+#endif
+        real *bx = nb->fx + (size_t)tid * N;
+        real *by = nb->fy + (size_t)tid * N;
+
+        // clear every buffer, in case the team is smaller than nthreads
+        #pragma omp for schedule(static)
+        for (int t = 0; t < nb->nthreads; t++)
+        {
+            memset(nb->fx + (size_t)t * N, 0, N * sizeof(real));
+            memset(nb->fy + (size_t)t * N, 0, N * sizeof(real));
+        }
+
+        // upper triangle of tile pairs; rows near the top hold more work,
+        // so hand them out one at a time
+        #pragma omp for schedule(dynamic, 1)
+        for (int k = 0; k < nt * nt; k++)
+        {
+            int I = k / nt, J = k % nt;
+
+            if (J < I) continue;
+
+            int i1 = (I + 1) * NBODY_TILE < N ? (I + 1) * NBODY_TILE : N;
+            int j1 = (J + 1) * NBODY_TILE < N ? (J + 1) * NBODY_TILE : N;
+            nbodyTilePair(px, py, bx, by, I * NBODY_TILE, i1,
+                          J * NBODY_TILE, j1, mass, limit);
+        }
+
+        // sum the per-thread buffers (the implicit barrier above makes
+        // them complete)
+        #pragma omp for schedule(static)
+        for (int i = 0; i < N; i++)
+        {
+            real sx = 0, sy = 0;
+
+            for (int t = 0; t < nb->nthreads; t++)
+            {
+                sx += nb->fx[(size_t)t * N + i];
+                sy += nb->fy[(size_t)t * N + i];
+            }
+
+            ax[i] = sx;
+            ay[i] = sy;
+        }
+    }
+}
+
+/*
+ * Barnes-Hut mode. Every step the bodies are sorted by the Morton key of
+ * their position (x and y bits interleaved, so bodies close in space are
+ * close in the array) and a quadtree is built over the sorted keys: a node
+ * is a range of bodies sharing a key prefix. Nodes with a single non-empty
+ * quadrant are skipped, so there are fewer than 2N nodes. A cell whose
+ * edge s, seen from distance d to its centre of mass, has s / d < theta
+ * (and does not contain the body) acts as one body of the cell's total
+ * mass; otherwise it is opened. Leaves are summed directly. theta = 0
+ * opens everything and gives the all-pairs answer.
+ *
+ * The key sort is a parallel radix sort and the subtrees below the top few
+ * levels are built as OpenMP tasks.
+ */
+
+// bodies per leaf
+#define NBODY_LEAF      8
+
+// key bits per dimension, i.e. the deepest level
+#define NBODY_LEVELS    16
+
+// subtrees smaller than this are built by the task that finds them
+#define NBODY_TASK_MIN  4096
+
+typedef struct
+{
+    real cx, cy;                // centre of mass
+    real m;                     // total mass
+    real ox, oy;                // box centre
+    real half;                  // box half edge
+    int child[4];               // node index, or -1
+    int begin, end;             // bodies, in Morton order
+} NBodyNode;
+
+typedef struct
+{
+    int N;
+    unsigned int *key, *key2;   // Morton keys, and radix sort scratch
+    int *idx, *idx2;            // body of each sorted slot
+    real *sx, *sy;              // positions in Morton order
+    NBodyNode *node;
+    int nnode;
+} NBodyTree;
+
+static inline int nbodyTreeInit(NBodyTree *t, int N)
+{
+    t->N    = N;
+    t->key  = (unsigned int *)malloc(N * sizeof(unsigned int));
+    t->key2 = (unsigned int *)malloc(N * sizeof(unsigned int));
+    t->idx  = (int *)malloc(N * sizeof(int));
+    t->idx2 = (int *)malloc(N * sizeof(int));
+    t->sx   = (real *)malloc(N * sizeof(real));
+    t->sy   = (real *)malloc(N * sizeof(real));
+    t->node = (NBodyNode *)malloc((2 * (size_t)N + 1) * sizeof(NBodyNode));
+    t->nnode = 0;
+    return (t->key == NULL || t->key2 == NULL || t->idx == NULL ||
+            t->idx2 == NULL || t->sx == NULL || t->sy == NULL ||
+            t->node == NULL);
+}
+
+static inline void nbodyTreeFree(NBodyTree *t)
+{
+    free(t->key);
+    free(t->key2);
+    free(t->idx);
+    free(t->idx2);
+    free(t->sx);
+    free(t->sy);
+    free(t->node);
+}
+
+// spread the low 16 bits of v to the even bits
+static inline unsigned int nbodySpread(unsigned int v)
+{
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+/*
+ * Sort key/idx by key, 8 bits per pass. Each thread counts its own slice,
+ * the counts are turned into per-thread offsets and each thread scatters
+ * its slice, which keeps the sort stable.
+ */
+static inline void nbodyRadixSort(NBodyTree *t)
+{
+    const int N = t->N;
+#ifdef _OPENMP
+    const int nthreads = omp_get_max_threads();
+#else
+    const int nthreads = 1;
+#endif
+    int *count = (int *)malloc((size_t)nthreads * 256 * sizeof(int));
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        #pragma omp parallel num_threads(nthreads)
+        {
+#ifdef _OPENMP
+            const int tid = omp_get_thread_num();
+            const int nt = omp_get_num_threads();
+#else
+            const int tid = 0;
+            const int nt = 1;
+#endif
+            int *c = count + tid * 256;
+            int i0 = (int)((long)N * tid / nt);
+            int i1 = (int)((long)N * (tid + 1) / nt);
+
+            memset(c, 0, 256 * sizeof(int));
+
+            for (int i = i0; i < i1; i++) c[(t->key[i] >> shift) & 0xff]++;
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                int sum = 0;
+
+                for (int d = 0; d < 256; d++)
+                {
+                    for (int k = 0; k < nt; k++)
+                    {
+                        int n = count[k * 256 + d];
+                        count[k * 256 + d] = sum;
+                        sum += n;
+                    }
+                }
+            }
+
+            for (int i = i0; i < i1; i++)
+            {
+                int dst = c[(t->key[i] >> shift) & 0xff]++;
+                t->key2[dst] = t->key[i];
+                t->idx2[dst] = t->idx[i];
+            }
+        }
+
+        unsigned int *k = t->key;
+        t->key = t->key2;
+        t->key2 = k;
+        int *p = t->idx;
+        t->idx = t->idx2;
+        t->idx2 = p;
+    }
+
+    free(count);
+}
+
+// first sorted slot in [b, e) whose key has quadrant >= q at shift
+static inline int nbodySplit(const unsigned int *key, int b, int e,
+                             int shift, unsigned int q)
+{
+    while (b < e)
+    {
+        int mid = b + (e - b) / 2;
+
+        if (((key[mid] >> shift) & 3) < q) b = mid + 1;
+        else e = mid;
+    }
+
+    return b;
+}
+
+static inline int nbodyNewNodes(NBodyTree *t, int n)
+{
+    int first;
+
+    #pragma omp atomic capture
+    {
+        first = t->nnode;
+        t->nnode += n;
+    }
+
+    return first;
+}
+
+/*
+ * Fill node id with the bodies [b, e), which share the key bits above
+ * level; (ox, oy, half) is the box at that level. Children are built as
+ * tasks when they are big enough.
+ */
+static inline void nbodyBuild(NBodyTree *t, int id, int b, int e,
+                              int level, real ox, real oy, real half,
+                              real mass)
+{
+    NBodyNode *n = &t->node[id];
+    int cut[5];
+
+    // skip levels where every body falls in the same quadrant
+    for (;;)
+    {
+        cut[0] = b;
+        cut[4] = e;
+
+        if (e - b <= NBODY_LEAF || level == NBODY_LEVELS) break;
+
+        int shift = 2 * (NBODY_LEVELS - 1 - level);
+
+        for (unsigned int q = 1; q < 4; q++)
+            cut[q] = nbodySplit(t->key, b, e, shift, q);
+
+        int nonempty = 0, last = 0;
+
+        for (int q = 0; q < 4; q++)
+        {
+            if (cut[q + 1] > cut[q])
+            {
+                nonempty++;
+                last = q;
+            }
+        }
+
+        if (nonempty > 1) break;
+
+        // quadrant bit 0 is x, bit 1 is y
+        half /= 2;
+        ox += (last & 1) ? half : -half;
+        oy += (last & 2) ? half : -half;
+        level++;
+    }
+
+    n->ox = ox;
+    n->oy = oy;
+    n->half = half;
+    n->begin = b;
+    n->end = e;
+
+    for (int q = 0; q < 4; q++) n->child[q] = -1;
+
+    if (e - b <= NBODY_LEAF || level == NBODY_LEVELS)
+    {
+        real cx = 0, cy = 0;
+
+        for (int i = b; i < e; i++)
+        {
+            cx += t->sx[i];
+            cy += t->sy[i];
+        }
+
+        n->m  = mass * (e - b);
+        n->cx = cx / (e - b);
+        n->cy = cy / (e - b);
+        return;
+    }
+
+    int nc = 0;
+
+    for (int q = 0; q < 4; q++) nc += cut[q + 1] > cut[q];
+
+    int c = nbodyNewNodes(t, nc);
+
+    for (int q = 0; q < 4; q++)
+    {
+        if (cut[q + 1] == cut[q]) continue;
+
+        int cb = cut[q], ce = cut[q + 1], cid = c++;
+        real h = half / 2;
+        real cox = ox + ((q & 1) ? h : -h);
+        real coy = oy + ((q & 2) ? h : -h);
+        n->child[q] = cid;
+
+        #pragma omp task if (ce - cb >= NBODY_TASK_MIN)
+        nbodyBuild(t, cid, cb, ce, level + 1, cox, coy, h, mass);
+    }
+
+    #pragma omp taskwait
+
+    real cx = 0, cy = 0, m = 0;
+
+    for (int q = 0; q < 4; q++)
+    {
+        if (n->child[q] < 0) continue;
+
+        NBodyNode *ch = &t->node[n->child[q]];
+        cx += ch->cx * ch->m;
+        cy += ch->cy * ch->m;
+        m  += ch->m;
+    }
+
+    n->m  = m;
+    n->cx = cx / m;
+    n->cy = cy / m;
+}
+
+// sort the bodies by Morton key and build the tree over them
+static inline void nbodyTreeBuild(NBodyTree *t, const real *px,
+                                  const real *py, real mass)
+{
+    const int N = t->N;
+    real xmin = px[0], xmax = px[0], ymin = py[0], ymax = py[0];
+
+    #pragma omp parallel for reduction(min:xmin, ymin) reduction(max:xmax, ymax)
+    for (int i = 0; i < N; i++)
+    {
+        if (px[i] < xmin) xmin = px[i];
+
+        if (px[i] > xmax) xmax = px[i];
+
+        if (py[i] < ymin) ymin = py[i];
+
+        if (py[i] > ymax) ymax = py[i];
+    }
+
+    // square root box, a little larger so no key overflows 16 bits
+    real edge = (xmax - xmin > ymax - ymin ? xmax - xmin : ymax - ymin);
+    edge = edge * (real)1.001 + (real)1e-6;
+    real scale = (real)(1 << NBODY_LEVELS) / edge;
+
+    #pragma omp parallel for
+    for (int i = 0; i < N; i++)
+    {
+        unsigned int kx = (unsigned int)((px[i] - xmin) * scale);
+        unsigned int ky = (unsigned int)((py[i] - ymin) * scale);
+
+        if (kx > 0xffff) kx = 0xffff;
+
+        if (ky > 0xffff) ky = 0xffff;
+
+        t->key[i] = nbodySpread(kx) | (nbodySpread(ky) << 1);
+        t->idx[i] = i;
+    }
+
+    nbodyRadixSort(t);
+
+    #pragma omp parallel for
+    for (int i = 0; i < N; i++)
+    {
+        t->sx[i] = px[t->idx[i]];
+        t->sy[i] = py[t->idx[i]];
+    }
+
+    t->nnode = 1;
+
+    #pragma omp parallel
+    #pragma omp single
+    nbodyBuild(t, 0, 0, N, 0, xmin + edge / 2, ymin + edge / 2, edge / 2,
+               mass);
+}
+
+// acceleration on sorted body i
+static inline void nbodyTreeWalk(const NBodyTree *t, int i, real mass,
+                                 real limit, real theta2, real *ax, real *ay)
+{
+    const real xi = t->sx[i];
+    const real yi = t->sy[i];
+    real axi = 0, ayi = 0;
+    int stack[4 * NBODY_LEVELS + 4];
+    int top = 0;
+
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const NBodyNode *n = &t->node[stack[--top]];
+        real rx = n->cx - xi;
+        real ry = n->cy - yi;
+        real d2 = rx * rx + ry * ry;
+        real s = 2 * n->half;
+        int inside = (i >= n->begin && i < n->end);
+
+        if (!inside && s * s < theta2 * d2)
+        {
+            // far enough: the whole cell as one body
+            if (d2 < limit) d2 = limit;
+
+            real r = (real)(1.0 / sqrt(d2));
+            real f = n->m * r * r * r;
+            axi += rx * f;
+            ayi += ry * f;
+        }
+        else if (n->child[0] < 0 && n->child[1] < 0 && n->child[2] < 0 &&
+                 n->child[3] < 0)
+        {
+            for (int j = n->begin; j < n->end; j++)
+            {
+                if (j == i) continue;
+
+                real qx = t->sx[j] - xi;
+                real qy = t->sy[j] - yi;
+                real q2 = qx * qx + qy * qy;
+
+                if (q2 < limit) q2 = limit;
+
+                real r = (real)(1.0 / sqrt(q2));
+                real f = mass * r * r * r;
+                axi += qx * f;
+                ayi += qy * f;
+            }
+        }
+        else
+        {
+            for (int q = 0; q < 4; q++)
+                if (n->child[q] >= 0) stack[top++] = n->child[q];
+        }
+    }
+
+    *ax = axi;
+    *ay = ayi;
+}
+
+// Barnes-Hut accelerations of all bodies into ax, ay
+static inline void nbodyTreeAccel(NBodyTree *t, const real *px,
+                                  const real *py, real *ax, real *ay,
+                                  real mass, real limit, real theta)
+{
+    nbodyTreeBuild(t, px, py, mass);
+
+    // walk in Morton order, so neighbouring walks share cells in cache
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < t->N; i++)
+    {
+        nbodyTreeWalk(t, i, mass, limit, theta * theta, &ax[t->idx[i]],
+                      &ay[t->idx[i]]);
+    }
+}
+
+#endif // _NBODY_H
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits>
+
+#ifndef _REDUCE_H
+#define _REDUCE_H
+
+/*
+ * Parallel host reduction, the CPU counterpart of the reduction kernels.
+ *
+ * Unlike recursiveReduce the input is left untouched. Each thread runs an
+ * unrolled loop over REDUCE_LANES independent accumulators, which the
+ * compiler keeps in SIMD registers (acc[k] only ever sees data[i + k], so
+ * no reassociation is needed to vectorize it, even for floats). The lanes
+ * and then the per-thread partials are combined pairwise, like the
+ * in-shared-memory tree of reduceCompleteUnrollWarps8.
+ *
+ * The element type and operator are template parameters. An operator is a
+ * struct with an identity(), returned for empty input, and an
+ * operator()(a, b); ReduceSum, ReduceMin and ReduceMax are provided:
+ *
+ *     int sum   = reduceSum(h_idata, size);
+ *     float top = reduce(h_fdata, n, ReduceMax<float>(), nthreads);
+ *
+ * Floating-point sums depend on the order of the additions. With
+ * deterministic set, the data is cut into fixed REDUCE_CHUNK pieces no
+ * matter how many threads there are, each chunk is reduced the same way and
+ * the chunk results are combined by the same tree, so the result is
+ * bitwise identical for any thread count.
+ */
+
+// independent accumulators per thread; 4 AVX registers of floats
+#define REDUCE_LANES    32
+
+// elements per piece in deterministic mode
+#define REDUCE_CHUNK    (1 << 16)
+
+template <typename T>
+struct ReduceSum
+{
+    T identity() const { return T(0); }
+    T operator()(const T a, const T b) const { return a + b; }
+};
+
+template <typename T>
+struct ReduceMin
+{
+    T identity() const { return std::numeric_limits<T>::max(); }
+    T operator()(const T a, const T b) const { return b < a ? b : a; }
+};
+
+template <typename T>
+struct ReduceMax
+{
+    T identity() const { return std::numeric_limits<T>::lowest(); }
+    T operator()(const T a, const T b) const { return a < b ? b : a; }
+};
+
+// combine n partials pairwise in place, neighbours first; returns part[0]
+template <typename T, typename Op>
+inline T reduceTree(T *part, size_t n, const Op &op)
+{
+    for (size_t stride = 1; stride < n; stride *= 2)
+    {
+        for (size_t i = 0; i + stride < n; i += 2 * stride)
+        {
+            part[i] = op(part[i], part[i + stride]);
+        }
+    }
+
+    return part[0];
+}
+
+/*
+ * Reduce n > 0 elements on the calling thread. The lanes start from the
+ * first elements rather than from op.identity(), so an operator whose
+ * identity is only a bound (the largest value for min) adds nothing.
+ */
+template <typename T, typename Op>
+inline T reduceSerial(const T *data, size_t n, const Op &op)
+{
+    if (n < 2 * REDUCE_LANES)
+    {
+        T r = data[0];
+
+        for (size_t i = 1; i < n; i++) r = op(r, data[i]);
+
+        return r;
+    }
+
+    T acc[REDUCE_LANES];
+
+    for (int k = 0; k < REDUCE_LANES; k++) acc[k] = data[k];
+
+    size_t i = REDUCE_LANES;
+
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES)
+    {
+        for (int k = 0; k < REDUCE_LANES; k++)
+        {
+            acc[k] = op(acc[k], data[i + k]);
+        }
+    }
+
+    // tail lands in the low lanes
+    for (int k = 0; i < n; i++, k++) acc[k] = op(acc[k], data[i]);
+
+    return reduceTree(acc, REDUCE_LANES, op);
+}
+
+template <typename T, typename Op>
+struct ReduceJob
+{
+    const T *data;
+    size_t n;
+    const Op *op;
+    T *part;                // one per thread, or one per chunk
+    size_t npart;
+    bool deterministic;
+    int id, nthreads;
+};
+
+template <typename T, typename Op>
+void *reduceWorker(void *arg)
+{
+    ReduceJob<T, Op> *job = (ReduceJob<T, Op> *)arg;
+
+    if (job->deterministic)
+    {
+        // chunks dealt round robin; the chunk results do not depend on who
+        // computes them
+        for (size_t c = job->id; c < job->npart; c += job->nthreads)
+        {
+            size_t i0 = c * REDUCE_CHUNK;
+            size_t len = job->n - i0 < REDUCE_CHUNK ? job->n - i0 :
+                         REDUCE_CHUNK;
+            job->part[c] = reduceSerial(job->data + i0, len, *job->op);
+        }
+    }
+    else
+    {
+        size_t i0 = job->n * job->id / job->nthreads;
+        size_t i1 = job->n * (job->id + 1) / job->nthreads;
+        job->part[job->id] = reduceSerial(job->data + i0, i1 - i0, *job->op);
+    }
+
+    return NULL;
+}
+
+/*
+ * Reduce data[0, n) with op on nthreads threads (0: one per online core).
+ * Returns op.identity() for n == 0.
+ */
+template <typename T, typename Op>
+T reduce(const T *data, size_t n, const Op &op, int nthreads = 0,
+         bool deterministic = false)
+{
+    if (n == 0) return op.identity();
+
+    if (nthreads < 1) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nthreads < 1) nthreads = 1;
+
+    size_t nchunk = (n + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+
+    // no point in threads that would get less than a chunk
+    if ((size_t)nthreads > nchunk) nthreads = (int)nchunk;
+
+    if (nthreads == 1 && !deterministic) return reduceSerial(data, n, op);
+
+    size_t npart = deterministic ? nchunk : nthreads;
+    T *part = (T *)malloc(npart * sizeof(T));
+    pthread_t *tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    ReduceJob<T, Op> *job = (ReduceJob<T, Op> *)malloc(nthreads *
+                            sizeof(ReduceJob<T, Op>));
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        job[i].data          = data;
+        job[i].n             = n;
+        job[i].op            = &op;
+        job[i].part          = part;
+        job[i].npart         = npart;
+        job[i].deterministic = deterministic;
+        job[i].id            = i;
+        job[i].nthreads      = nthreads;
+
+        if (i > 0) pthread_create(&tid[i], NULL, reduceWorker<T, Op>, &job[i]);
+    }
+
+    reduceWorker<T, Op>(&job[0]);
+
+    for (int i = 1; i < nthreads; i++) pthread_join(tid[i], NULL);
+
+    T result = reduceTree(part, npart, op);
+
+    free(part);
+    free(tid);
+    free(job);
+    return result;
+}
+
+template <typename T>
+T reduceSum(const T *data, size_t n, int nthreads = 0,
+            bool deterministic = false)
+{
+    return reduce(data, n, ReduceSum<T>(), nthreads, deterministic);
+}
+
+template <typename T>
+T reduceMin(const T *data, size_t n, int nthreads = 0)
+{
+    return reduce(data, n, ReduceMin<T>(), nthreads);
+}
+
+template <typename T>
+T reduceMax(const T *data, size_t n, int nthreads = 0)
+{
+    return reduce(data, n, ReduceMax<T>(), nthreads);
+}
+
+#endif // _REDUCE_H
@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#ifndef _RNG_H
+#define _RNG_H
+
+/*
+ * Host random numbers in bulk, for the rand() replacements of
+ * replace-rand.cu and replace-rand-streams.cu.
+ *
+ * The generator is Philox4x32-10, the counter-based generator cuRAND offers
+ * as CURAND_RNG_PSEUDO_PHILOX4_32_10: ten rounds of multiply and xor turn a
+ * 128-bit counter and a 64-bit key into four random words, with no state to
+ * carry from one block to the next. As with curand_init(seed, subsequence,
+ * offset), the seed is the key and the subsequence the upper half of the
+ * counter, so every thread can draw from its own subsequence and none ever
+ * meets another. rngUniform and rngNormal fill an array in groups of eight
+ * blocks, eight AVX2 lanes, 32 values:
+ *
+ *   uniform   value j of a group is word j / 8 of block j % 8, mapped to
+ *             (0, 1] like curand_uniform
+ *   normal    Box-Muller on words 0 and 1, then 2 and 3, of each block,
+ *             with polynomial log, sin and cos; the cosines of a pair of
+ *             words fill 8 values and the sines the next 8
+ *
+ * A fill always takes whole groups, skipping what is left of the last one;
+ * the values do not depend on AVX2 being there.
+ *
+ * RngService is cuda_device_rand as a structure: rngNext hands out one
+ * value from a buffer of len, and an empty buffer is swapped for a second
+ * one that a helper thread refilled in the meantime (as refill_randoms runs
+ * on a stream), or refilled in place without the helper. rngRand is the
+ * rand() replacement: one service per calling thread, created on its first
+ * call with the next free subsequence, so threads share nothing but that
+ * counter. rngServiceInit returns 0, or -1 when out of memory or out of
+ * threads.
+ */
+
+// values per buffer of rngRand
+#ifndef RNG_BUFFER
+#define RNG_BUFFER          65536
+#endif
+
+// seed of rngRand, the seed of the cuRAND samples
+#ifndef RNG_SEED
+#define RNG_SEED            9384ULL
+#endif
+
+// refill of rngRand on a helper thread
+#ifndef RNG_BACKGROUND
+#define RNG_BACKGROUND      1
+#endif
+
+// values per group, eight blocks of four words
+#define RNG_GROUP           32
+
+#define RNG_M0              0xD2511F53u
+#define RNG_M1              0xCD9E8D57u
+#define RNG_W0              0x9E3779B9u
+#define RNG_W1              0xBB67AE85u
+
+typedef struct
+{
+    uint32_t key[2];
+    uint64_t subsequence;
+    uint64_t counter;       // next block, a multiple of eight
+} RngPhilox;
+
+typedef struct
+{
+    RngPhilox gen;
+    int normal;
+
+    float *cur;             // being handed out
+    float *next;            // being refilled
+    int len, used;
+
+    int background;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int ready;              // next is full
+    int quit;
+} RngService;
+
+static inline void rngInit(RngPhilox *g, uint64_t seed, uint64_t subsequence)
+{
+    g->key[0] = (uint32_t)seed;
+    g->key[1] = (uint32_t)(seed >> 32);
+    g->subsequence = subsequence;
+    g->counter = 0;
+}
+
+// skip n values, rounded up to whole groups
+static inline void rngSkip(RngPhilox *g, uint64_t n)
+{
+    g->counter += (n + RNG_GROUP - 1) / RNG_GROUP * 8;
+}
+
+static inline void rngBlock(uint32_t c[4], const uint32_t key[2])
+{
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int r = 0; r < 10; r++)
+    {
+        uint64_t p0 = (uint64_t)RNG_M0 * c[0];
+        uint64_t p1 = (uint64_t)RNG_M1 * c[2];
+        uint32_t t0 = (uint32_t)(p1 >> 32) ^ c[1] ^ k0;
+        uint32_t t2 = (uint32_t)(p0 >> 32) ^ c[3] ^ k1;
+
+        c[0] = t0;
+        c[1] = (uint32_t)p1;
+        c[2] = t2;
+        c[3] = (uint32_t)p0;
+        k0 += RNG_W0;
+        k1 += RNG_W1;
+    }
+}
+
+// the words of the next group: w[k][l] is word k of block l
+static inline void rngGroup(RngPhilox *g, uint32_t w[4][8])
+{
+    for (int l = 0; l < 8; l++)
+    {
+        uint64_t n = g->counter + l;
+        uint32_t c[4] = { (uint32_t)n, (uint32_t)(n >> 32),
+                          (uint32_t)g->subsequence,
+                          (uint32_t)(g->subsequence >> 32)
+                        };
+
+        rngBlock(c, g->key);
+
+        for (int k = 0; k < 4; k++) w[k][l] = c[k];
+    }
+
+    g->counter += 8;
+}
+
+static inline float rngToUniform(uint32_t x)
+{
+    return (float)((x >> 8) + 1) * (1.0f / 16777216.0f);
+}
+
+// r cos(2 pi u2) and r sin(2 pi u2), r = sqrt(-2 log u1)
+static inline void rngBoxMuller(float u1, float u2, float *z0, float *z1)
+{
+    float r = sqrtf(-2.0f * logf(u1));
+    float t = 6.28318530717958647692f * u2;
+
+    *z0 = r * cosf(t);
+    *z1 = r * sinf(t);
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+// high and low words of a * m in each lane
+static inline __m256i rngMulhilo(__m256i a, __m256i m, __m256i *lo)
+{
+    __m256i even = _mm256_mul_epu32(a, m);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+
+    *lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+/*
+ * The words of the next two groups: w[j][k] lane l is word k of block l of
+ * group j. Two groups, sixteen blocks, keep two chains of rounds in flight.
+ */
+static inline void rngGroup8(RngPhilox *g, __m256i w[2][4])
+{
+    const __m256i m0 = _mm256_set1_epi32((int)RNG_M0);
+    const __m256i m1 = _mm256_set1_epi32((int)RNG_M1);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i c[2][4];
+    uint32_t k0 = g->key[0], k1 = g->key[1];
+
+    #pragma GCC unroll 2
+    for (int j = 0; j < 2; j++)
+    {
+        uint64_t n = g->counter + 8 * j;
+
+        c[j][0] = _mm256_add_epi32(_mm256_set1_epi32((int)(uint32_t)n), lane);
+        c[j][1] = _mm256_set1_epi32((int)(uint32_t)(n >> 32));
+        c[j][2] = _mm256_set1_epi32((int)(uint32_t)g->subsequence);
+        c[j][3] = _mm256_set1_epi32((int)(uint32_t)(g->subsequence >> 32));
+    }
+
+    for (int r = 0; r < 10; r++)
+    {
+        __m256i key0 = _mm256_set1_epi32((int)k0);
+        __m256i key1 = _mm256_set1_epi32((int)k1);
+
+        // unrolled, so that c stays in registers
+        #pragma GCC unroll 2
+        for (int j = 0; j < 2; j++)
+        {
+            __m256i l0, l1;
+            __m256i h0 = rngMulhilo(c[j][0], m0, &l0);
+            __m256i h1 = rngMulhilo(c[j][2], m1, &l1);
+
+            c[j][0] = _mm256_xor_si256(_mm256_xor_si256(h1, c[j][1]), key0);
+            c[j][1] = l1;
+            c[j][2] = _mm256_xor_si256(_mm256_xor_si256(h0, c[j][3]), key1);
+            c[j][3] = l0;
+        }
+
+        k0 += RNG_W0;
+        k1 += RNG_W1;
+    }
+
+    for (int j = 0; j < 2; j++)
+        for (int k = 0; k < 4; k++) w[j][k] = c[j][k];
+
+    g->counter += 16;
+}
+
+static inline __m256 rngToUniform8(__m256i x)
+{
+    __m256i v = _mm256_add_epi32(_mm256_srli_epi32(x, 8),
+                                 _mm256_set1_epi32(1));
+
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(v),
+                         _mm256_set1_ps(1.0f / 16777216.0f));
+}
+
+// log of x > 0, the polynomial of Cephes logf
+static inline __m256 rngLog8(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256i bits = _mm256_castps_si256(x);
+    __m256i exp = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+                                   _mm256_set1_epi32(126));
+    __m256i man = _mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF));
+    __m256 e = _mm256_cvtepi32_ps(exp);
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(man,
+                                   _mm256_set1_epi32(0x3F000000)));
+
+    // m in [0.5, 1); take it to [sqrt(1/2), sqrt(2)) - 1
+    __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781186547524f),
+                                 _CMP_LT_OS);
+    e = _mm256_sub_ps(e, _mm256_and_ps(small, one));
+    m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(small, m)), one);
+
+    __m256 z = _mm256_mul_ps(m, m);
+    __m256 y = _mm256_set1_ps(7.0376836292E-2f);
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.1514610310E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.1676998740E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.2420140846E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.4249322787E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.6668057665E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(2.0000714765E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-2.4999993993E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(3.3333331174E-1f));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440E-4f), y);
+    y = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, y);
+
+    return _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f),
+                           _mm256_add_ps(m, y));
+}
+
+/*
+ * cos and sin of 2 pi u, u in [0, 1]: u = q / 4 + t with q the nearest
+ * quarter turn, the polynomials of Cephes sincosf on 2 pi t in
+ * [-pi / 4, pi / 4], swapped and negated by q.
+ */
+static inline void rngSinCos8(__m256 u, __m256 *c, __m256 *s)
+{
+    __m256 q = _mm256_round_ps(_mm256_mul_ps(u, _mm256_set1_ps(4.0f)),
+                               _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 x = _mm256_mul_ps(_mm256_fnmadd_ps(q, _mm256_set1_ps(0.25f), u),
+                             _mm256_set1_ps(6.28318530717958647692f));
+    __m256 z = _mm256_mul_ps(x, x);
+
+    __m256 sp = _mm256_set1_ps(-1.9515295891E-4f);
+    sp = _mm256_fmadd_ps(sp, z, _mm256_set1_ps(8.3321608736E-3f));
+    sp = _mm256_fmadd_ps(sp, z, _mm256_set1_ps(-1.6666654611E-1f));
+    sp = _mm256_fmadd_ps(_mm256_mul_ps(sp, z), x, x);
+
+    __m256 cp = _mm256_set1_ps(2.443315711809948E-5f);
+    cp = _mm256_fmadd_ps(cp, z, _mm256_set1_ps(-1.388731625493765E-3f));
+    cp = _mm256_fmadd_ps(cp, z, _mm256_set1_ps(4.166664568298827E-2f));
+    cp = _mm256_fmadd_ps(cp, _mm256_mul_ps(z, z),
+                         _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z,
+                                          _mm256_set1_ps(1.0f)));
+
+    __m256i qi = _mm256_cvtps_epi32(q);
+    __m256 swap = _mm256_castsi256_ps(_mm256_slli_epi32(qi, 31));
+    __m256i q1 = _mm256_add_epi32(qi, _mm256_set1_epi32(1));
+    __m256 negc = _mm256_castsi256_ps(_mm256_slli_epi32(q1, 30));
+    __m256 negs = _mm256_castsi256_ps(_mm256_slli_epi32(qi, 30));
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    // q odd swaps the two; cos is negative for q = 1, 2, sin for q = 2, 3
+    __m256 cv = _mm256_blendv_ps(cp, sp, swap);
+    __m256 sv = _mm256_blendv_ps(sp, cp, swap);
+    *c = _mm256_xor_ps(cv, _mm256_and_ps(negc, sign));
+    *s = _mm256_xor_ps(sv, _mm256_and_ps(negs, sign));
+}
+
+#endif
+
+// n uniform values in (0, 1]
+static inline void rngUniform(RngPhilox *g, float *out, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    for (; i + 2 * RNG_GROUP <= n; i += 2 * RNG_GROUP)
+    {
+        __m256i w[2][4];
+
+        rngGroup8(g, w);
+
+        for (int k = 0; k < 8; k++)
+            _mm256_storeu_ps(out + i + 8 * k, rngToUniform8(w[k / 4][k % 4]));
+    }
+#endif
+
+    for (; i < n; i += RNG_GROUP)
+    {
+        uint32_t w[4][8];
+
+        rngGroup(g, w);
+
+        for (int j = 0; j < RNG_GROUP && i + j < n; j++)
+            out[i + j] = rngToUniform(w[j / 8][j % 8]);
+    }
+}
+
+// n normal values, mean 0 and standard deviation 1
+static inline void rngNormal(RngPhilox *g, float *out, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    const __m256 m2 = _mm256_set1_ps(-2.0f);
+
+    for (; i + 2 * RNG_GROUP <= n; i += 2 * RNG_GROUP)
+    {
+        __m256i w[2][4];
+
+        rngGroup8(g, w);
+
+        for (int k = 0; k < 8; k += 2)
+        {
+            __m256 u = rngToUniform8(w[k / 4][k % 4]);
+            __m256 r = _mm256_sqrt_ps(_mm256_mul_ps(m2, rngLog8(u)));
+            __m256 c, s;
+
+            rngSinCos8(rngToUniform8(w[k / 4][k % 4 + 1]), &c, &s);
+            _mm256_storeu_ps(out + i + 8 * k, _mm256_mul_ps(r, c));
+            _mm256_storeu_ps(out + i + 8 * k + 8, _mm256_mul_ps(r, s));
+        }
+    }
+#endif
+
+    for (; i < n; i += RNG_GROUP)
+    {
+        uint32_t w[4][8];
+        float z[RNG_GROUP];
+
+        rngGroup(g, w);
+
+        for (int k = 0; k < 4; k += 2)
+        {
+            for (int l = 0; l < 8; l++)
+            {
+                rngBoxMuller(rngToUniform(w[k][l]), rngToUniform(w[k + 1][l]),
+                             z + 8 * k + l, z + 8 * k + 8 + l);
+            }
+        }
+
+        for (int j = 0; j < RNG_GROUP && i + j < n; j++) out[i + j] = z[j];
+    }
+}
+
+static inline void rngServiceFill(RngService *s, float *buf)
+{
+    if (s->normal)
+        rngNormal(&s->gen, buf, s->len);
+    else
+        rngUniform(&s->gen, buf, s->len);
+}
+
+static void *rngServiceWorker(void *arg)
+{
+    RngService *s = (RngService *)arg;
+
+    pthread_mutex_lock(&s->lock);
+
+    for (;;)
+    {
+        while (s->ready && !s->quit) pthread_cond_wait(&s->cond, &s->lock);
+
+        if (s->quit) break;
+
+        // next is not touched by the consumer until ready is set
+        pthread_mutex_unlock(&s->lock);
+        rngServiceFill(s, s->next);
+        pthread_mutex_lock(&s->lock);
+
+        s->ready = 1;
+        pthread_cond_broadcast(&s->cond);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+static inline void rngServiceFree(RngService *s)
+{
+    if (s->background)
+    {
+        pthread_mutex_lock(&s->lock);
+        s->quit = 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->tid, NULL);
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+    }
+
+    free(s->cur);
+    free(s->next);
+    s->cur = s->next = NULL;
+    s->background = 0;
+}
+
+/*
+ * A service of len values (rounded up to a group) of one subsequence,
+ * uniform or normal, refilled on a helper thread with background.
+ */
+static inline int rngServiceInit(RngService *s, uint64_t seed,
+                                 uint64_t subsequence, int len, int normal,
+                                 int background)
+{
+    s->len = (len + RNG_GROUP - 1) / RNG_GROUP * RNG_GROUP;
+    s->normal = normal;
+    s->background = 0;
+    s->ready = 0;
+    s->quit = 0;
+    s->next = NULL;
+    rngInit(&s->gen, seed, subsequence);
+
+    if (posix_memalign((void **)&s->cur, 64, s->len * sizeof(float)) != 0)
+    {
+        s->cur = NULL;
+        return -1;
+    }
+
+    rngServiceFill(s, s->cur);
+    s->used = 0;
+
+    if (!background) return 0;
+
+    if (posix_memalign((void **)&s->next, 64, s->len * sizeof(float)) != 0)
+    {
+        s->next = NULL;
+        rngServiceFree(s);
+        return -1;
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    if (pthread_create(&s->tid, NULL, rngServiceWorker, s) != 0)
+    {
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+        rngServiceFree(s);
+        return -1;
+    }
+
+    s->background = 1;
+
+    return 0;
+}
+
+// the buffer is spent: take the refilled one, or refill it here
+static void rngServiceRefill(RngService *s)
+{
+    if (s->background)
+    {
+        pthread_mutex_lock(&s->lock);
+
+        while (!s->ready) pthread_cond_wait(&s->cond, &s->lock);
+
+        float *t = s->cur;
+        s->cur = s->next;
+        s->next = t;
+        s->ready = 0;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    else
+    {
+        rngServiceFill(s, s->cur);
+    }
+
+    s->used = 0;
+}
+
+static inline float rngNext(RngService *s)
+{
+    if (s->used == s->len) rngServiceRefill(s);
+
+    return s->cur[s->used++];
+}
+
+static pthread_key_t rngKey;
+static pthread_once_t rngKeyOnce = PTHREAD_ONCE_INIT;
+static uint64_t rngThreads = 0;
+static __thread RngService *rngLocal = NULL;
+
+static void rngLocalFree(void *p)
+{
+    rngServiceFree((RngService *)p);
+    free(p);
+}
+
+static void rngKeyCreate(void)
+{
+    pthread_key_create(&rngKey, rngLocalFree);
+}
+
+static RngService *rngLocalCreate(void)
+{
+    RngService *s = (RngService *)malloc(sizeof(RngService));
+
+    if (s == NULL ||
+            rngServiceInit(s, RNG_SEED, __sync_fetch_and_add(&rngThreads, 1),
+                           RNG_BUFFER, 0, RNG_BACKGROUND) != 0)
+    {
+        fprintf(stderr, "rngRand: out of memory\n");
+        exit(1);
+    }
+
+    pthread_once(&rngKeyOnce, rngKeyCreate);
+    pthread_setspecific(rngKey, s);
+    rngLocal = s;
+
+    return s;
+}
+
+// rand() / RAND_MAX, in (0, 1], from the calling thread's own service
+static inline float rngRand(void)
+{
+    RngService *s = rngLocal;
+
+    if (s == NULL) s = rngLocalCreate();
+
+    return rngNext(s);
+}
+
+#endif // _RNG_H
@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+/*
+ * Background snapshot writer for 2D float fields.
+ *
+ * The solver takes a staging buffer from a small ring (snapAcquire), fills it
+ * (memcpy, cudaMemcpyAsync into a pinned buffer, ...) and hands it back with
+ * snapSubmit. A writer thread compresses each buffer and appends it to a
+ * single container file, then returns the buffer to the ring. The solver
+ * only waits when every staging buffer is still queued for writing.
+ *
+ * Compression modes:
+ *
+ *   SNAP_RAW       the floats as they are
+ *   SNAP_LOSSLESS  XOR of each float's bits with the previous one, then the
+ *                  bytes shuffled into four planes and run-length coded;
+ *                  decodes bit for bit
+ *   SNAP_BOUNDED   each value rounded to a multiple of tol, then integer
+ *                  deltas, zigzag, shuffle and run-length coding as above;
+ *                  decodes within tol / 2 plus float rounding, so within tol
+ *
+ * Wave fields are smooth and mostly zero ahead of the wavefront, so the
+ * high byte planes are long runs and compress well.
+ *
+ * Container: the 8-byte magic "SNAPFILE", then one SnapFrame header and its
+ * payload per snapshot, then an index of SnapEntry records and a trailer
+ * holding the index offset, the frame count and the magic "SNAPINDX".
+ * snapReadFrame reads a frame back.
+ *
+ * snapSubmit refuses a frame larger than a staging buffer, and snapClose
+ * returns -1 if any write to the container fell short (a full disk).
+ */
+
+#define SNAP_RAW        0
+#define SNAP_LOSSLESS   1
+#define SNAP_BOUNDED    2
+
+typedef struct
+{
+    int32_t  istep;
+    int32_t  nx;
+    int32_t  ny;
+    int32_t  mode;
+    float    tol;
+    int32_t  pad;
+    uint64_t nbytes;        // payload bytes that follow
+} SnapFrame;
+
+typedef struct
+{
+    int32_t  istep;
+    int32_t  pad;
+    uint64_t offset;        // of the SnapFrame header
+} SnapEntry;
+
+typedef struct
+{
+    float *buf;
+    int istep, nx, ny;
+} SnapJob;
+
+typedef struct
+{
+    FILE *fp;
+    int mode;
+    float tol;
+    size_t nfloats;         // capacity of one staging buffer
+
+    // staging ring
+    int nbuf;
+    float **buf;
+    float **freeList;
+    int nfree;
+    SnapJob *queue;
+    int qhead, qcount;
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty, notFull;
+    pthread_t writer;
+    void (*release)(void *);
+
+    // writer-side scratch and index
+    uint32_t *words;
+    unsigned char *planes, *packed;
+    SnapEntry *index;
+    int nframes, capIndex;
+    uint64_t offset;
+
+    int writeErr;           // a write fell short
+
+    // statistics
+    int nstall;
+    double rawBytes, fileBytes;
+} SnapWriter;
+
+/*
+ * Run-length coding, PackBits style: a control byte c < 128 is followed by
+ * c + 1 literal bytes; c >= 128 means the next byte repeats c - 126 times.
+ */
+static inline size_t snapRLE(const unsigned char *in, size_t n,
+                             unsigned char *out)
+{
+    size_t i = 0, o = 0;
+
+    while (i < n)
+    {
+        size_t run = 1;
+
+        while (i + run < n && run < 129 && in[i + run] == in[i]) run++;
+
+        if (run >= 2)
+        {
+            out[o++] = (unsigned char)(run + 126);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        size_t lit = 1;
+
+        while (i + lit < n && lit < 128 &&
+               !(i + lit + 1 < n && in[i + lit] == in[i + lit + 1]))
+            lit++;
+
+        out[o++] = (unsigned char)(lit - 1);
+        memcpy(out + o, in + i, lit);
+        o += lit;
+        i += lit;
+    }
+
+    return o;
+}
+
+static inline size_t snapUnRLE(const unsigned char *in, size_t n,
+                               unsigned char *out)
+{
+    size_t i = 0, o = 0;
+
+    while (i < n)
+    {
+        unsigned c = in[i++];
+
+        if (c < 128)
+        {
+            memcpy(out + o, in + i, c + 1);
+            i += c + 1;
+            o += c + 1;
+        }
+        else
+        {
+            memset(out + o, in[i++], c - 126);
+            o += c - 126;
+        }
+    }
+
+    return o;
+}
+
+static inline uint32_t snapBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    return u;
+}
+
+static inline float snapFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, 4);
+    return f;
+}
+
+// worst case payload for n floats
+static inline size_t snapBound(size_t n)
+{
+    return 4 * n + (4 * n) / 128 + 64;
+}
+
+/*
+ * Encode n floats into out (snapBound(n) bytes) with scratch words[n] and
+ * planes[4n]. Returns the payload size; *mode may drop from SNAP_BOUNDED to
+ * SNAP_LOSSLESS if a value is too large to quantize.
+ */
+static inline size_t snapEncode(const float *src, size_t n, int *mode,
+                                float tol, uint32_t *words,
+                                unsigned char *planes, unsigned char *out)
+{
+    if (*mode == SNAP_RAW)
+    {
+        memcpy(out, src, n * sizeof(float));
+        return n * sizeof(float);
+    }
+
+    if (*mode == SNAP_BOUNDED)
+    {
+        const double inv = 1.0 / tol;
+        int32_t prev = 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            double q = floor(src[i] * inv + 0.5);
+
+            // keeps the float rounding on decode under tol / 4
+            if (!(fabs(q) < 4194304.0))
+            {
+                *mode = SNAP_LOSSLESS;
+                break;
+            }
+
+            int32_t iq = (int32_t)q;
+            int32_t d  = iq - prev;
+            words[i]   = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);   // zigzag
+            prev = iq;
+        }
+    }
+
+    if (*mode == SNAP_LOSSLESS)
+    {
+        uint32_t prev = 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t u = snapBits(src[i]);
+            words[i] = u ^ prev;
+            prev = u;
+        }
+    }
+
+    // byte shuffle: plane b holds byte b of every word
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t w = words[i];
+        planes[i]         = (unsigned char)w;
+        planes[n + i]     = (unsigned char)(w >> 8);
+        planes[2 * n + i] = (unsigned char)(w >> 16);
+        planes[3 * n + i] = (unsigned char)(w >> 24);
+    }
+
+    return snapRLE(planes, 4 * n, out);
+}
+
+static inline void snapDecode(const unsigned char *in, size_t nbytes,
+                              size_t n, int mode, float tol,
+                              unsigned char *planes, float *dst)
+{
+    if (mode == SNAP_RAW)
+    {
+        memcpy(dst, in, n * sizeof(float));
+        return;
+    }
+
+    snapUnRLE(in, nbytes, planes);
+
+    uint32_t prev = 0;
+    int32_t iprev = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t w = (uint32_t)planes[i] | ((uint32_t)planes[n + i] << 8) |
+                     ((uint32_t)planes[2 * n + i] << 16) |
+                     ((uint32_t)planes[3 * n + i] << 24);
+
+        if (mode == SNAP_LOSSLESS)
+        {
+            prev ^= w;
+            dst[i] = snapFloat(prev);
+        }
+        else
+        {
+            iprev += (int32_t)((w >> 1) ^ (0u - (w & 1)));
+            dst[i] = (float)(iprev * (double)tol);
+        }
+    }
+}
+
+static inline void *snapWriterMain(void *arg)
+{
+    SnapWriter *w = (SnapWriter *)arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&w->lock);
+
+        while (w->qcount == 0 && !w->closing)
+            pthread_cond_wait(&w->notEmpty, &w->lock);
+
+        if (w->qcount == 0)
+        {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+
+        SnapJob job = w->queue[w->qhead];
+        w->qhead = (w->qhead + 1) % w->nbuf;
+        w->qcount--;
+        pthread_mutex_unlock(&w->lock);
+
+        size_t n = (size_t)job.nx * job.ny;
+        SnapFrame f;
+        memset(&f, 0, sizeof(f));
+        f.istep = job.istep;
+        f.nx    = job.nx;
+        f.ny    = job.ny;
+        f.mode  = w->mode;
+        f.tol   = w->tol;
+        f.nbytes = snapEncode(job.buf, n, &f.mode, f.tol, w->words,
+                              w->planes, w->packed);
+
+        // the staging buffer is free once it is encoded
+        pthread_mutex_lock(&w->lock);
+        w->freeList[w->nfree++] = job.buf;
+        pthread_cond_signal(&w->notFull);
+        pthread_mutex_unlock(&w->lock);
+
+        if (w->nframes == w->capIndex)
+        {
+            SnapEntry *index = (SnapEntry *)realloc(w->index,
+                               (2 * w->capIndex + 16) * sizeof(SnapEntry));
+
+            // a frame the index cannot hold is lost like a short write
+            if (index == NULL)
+            {
+                w->writeErr = 1;
+                continue;
+            }
+
+            w->index = index;
+            w->capIndex = 2 * w->capIndex + 16;
+        }
+
+        w->index[w->nframes].istep  = f.istep;
+        w->index[w->nframes].pad    = 0;
+        w->index[w->nframes].offset = w->offset;
+        w->nframes++;
+
+        if (fwrite(&f, sizeof(f), 1, w->fp) != 1 ||
+                fwrite(w->packed, 1, f.nbytes, w->fp) != f.nbytes)
+            w->writeErr = 1;
+
+        w->offset    += sizeof(f) + f.nbytes;
+        w->rawBytes  += n * sizeof(float);
+        w->fileBytes += sizeof(f) + f.nbytes;
+    }
+
+    return NULL;
+}
+
+// the ring and the writer scratch, whichever of them were allocated
+static inline void snapFreeBuffers(SnapWriter *w)
+{
+    for (int i = 0; w->buf != NULL && i < w->nbuf; i++)
+        if (w->buf[i] != NULL) w->release(w->buf[i]);
+
+    free(w->buf);
+    free(w->freeList);
+    free(w->queue);
+    free(w->words);
+    free(w->planes);
+    free(w->packed);
+    free(w->index);
+}
+
+/*
+ * Open a container for fields of up to nfloats values, with nbuf staging
+ * buffers from alloc (malloc if NULL; e.g. cudaMallocHost for pinned
+ * buffers) that release frees. Returns 0 on success, or 1 when the file
+ * cannot be written or a buffer or the writer thread cannot be had.
+ */
+static inline int snapOpen(SnapWriter *w, const char *fname, int nbuf,
+                           size_t nfloats, int mode, float tol,
+                           void *(*alloc)(size_t), void (*release)(void *))
+{
+    memset(w, 0, sizeof(*w));
+
+    w->fp = fopen(fname, "wb");
+
+    if (w->fp == NULL) return 1;
+
+    if (fwrite("SNAPFILE", 1, 8, w->fp) != 8)
+    {
+        fclose(w->fp);
+        return 1;
+    }
+
+    w->offset  = 8;
+    w->mode    = mode;
+    w->tol     = tol > 0.0f ? tol : 1.0e-6f;
+    w->nfloats = nfloats;
+    w->nbuf    = nbuf < 1 ? 1 : nbuf;
+    w->release = release ? release : free;
+
+    w->buf      = (float **)calloc(w->nbuf, sizeof(float *));
+    w->freeList = (float **)malloc(w->nbuf * sizeof(float *));
+    w->queue    = (SnapJob *)malloc(w->nbuf * sizeof(SnapJob));
+    w->words    = (uint32_t *)malloc(nfloats * sizeof(uint32_t));
+    w->planes   = (unsigned char *)malloc(4 * nfloats);
+    w->packed   = (unsigned char *)malloc(snapBound(nfloats));
+
+    int ok = w->buf != NULL && w->freeList != NULL && w->queue != NULL &&
+             w->words != NULL && w->planes != NULL && w->packed != NULL;
+
+    for (int i = 0; ok && i < w->nbuf; i++)
+    {
+        w->buf[i] = (float *)(alloc ? alloc(nfloats * sizeof(float))
+                              : malloc(nfloats * sizeof(float)));
+        w->freeList[w->nfree++] = w->buf[i];
+        ok = w->buf[i] != NULL;
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->notEmpty, NULL);
+    pthread_cond_init(&w->notFull, NULL);
+
+    if (!ok || pthread_create(&w->writer, NULL, snapWriterMain, w) != 0)
+    {
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->notEmpty);
+        pthread_cond_destroy(&w->notFull);
+        snapFreeBuffers(w);
+        fclose(w->fp);
+        return 1;
+    }
+
+    return 0;
+}
+
+// take a free staging buffer; waits only if the whole ring is queued
+static inline float *snapAcquire(SnapWriter *w)
+{
+    pthread_mutex_lock(&w->lock);
+
+    if (w->nfree == 0) w->nstall++;
+
+    while (w->nfree == 0) pthread_cond_wait(&w->notFull, &w->lock);
+
+    float *buf = w->freeList[--w->nfree];
+    pthread_mutex_unlock(&w->lock);
+    return buf;
+}
+
+/*
+ * Queue a filled staging buffer for writing. Returns 0, or -1 when nx * ny
+ * is more than a staging buffer holds; the buffer is then taken back
+ * unwritten.
+ */
+static inline int snapSubmit(SnapWriter *w, float *buf, int istep, int nx,
+                             int ny)
+{
+    pthread_mutex_lock(&w->lock);
+
+    if (nx < 0 || ny < 0 || (size_t)nx * ny > w->nfloats)
+    {
+        w->freeList[w->nfree++] = buf;
+        pthread_cond_signal(&w->notFull);
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    SnapJob *job = &w->queue[(w->qhead + w->qcount) % w->nbuf];
+    job->buf   = buf;
+    job->istep = istep;
+    job->nx    = nx;
+    job->ny    = ny;
+    w->qcount++;
+    pthread_cond_signal(&w->notEmpty);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+/*
+ * Write everything still queued, then the index, and free the ring.
+ * Returns 0, or -1 when a write to the container fell short.
+ */
+static inline int snapClose(SnapWriter *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_signal(&w->notEmpty);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->writer, NULL);
+
+    uint64_t indexOffset = w->offset;
+    uint64_t count = w->nframes;
+    if (fwrite(w->index, sizeof(SnapEntry), w->nframes, w->fp) !=
+            (size_t)w->nframes ||
+            fwrite(&indexOffset, sizeof(indexOffset), 1, w->fp) != 1 ||
+            fwrite(&count, sizeof(count), 1, w->fp) != 1 ||
+            fwrite("SNAPINDX", 1, 8, w->fp) != 8)
+        w->writeErr = 1;
+
+    if (fclose(w->fp) != 0) w->writeErr = 1;
+
+    if (w->nframes > 0)
+    {
+        printf("snapshots: %d frames, %.2f MB -> %.2f MB (%.1fx), "
+               "solver waited %d times\n", w->nframes,
+               w->rawBytes / (1024.0 * 1024.0),
+               w->fileBytes / (1024.0 * 1024.0),
+               w->rawBytes / w->fileBytes, w->nstall);
+        fflush(stdout);
+    }
+
+    snapFreeBuffers(w);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->notEmpty);
+    pthread_cond_destroy(&w->notFull);
+
+    return w->writeErr ? -1 : 0;
+}
+
+/*
+ * Read frame iframe of a container into dst (nx * ny floats, or NULL to
+ * query the size). Returns the number of frames, or -1 on error.
+ */
+static inline int snapReadFrame(const char *fname, int iframe, float *dst,
+                                int *istep, int *nx, int *ny)
+{
+    FILE *fp = fopen(fname, "rb");
+    uint64_t indexOffset, count;
+    char magic[8];
+
+    if (fp == NULL) return -1;
+
+    if (fseek(fp, -24, SEEK_END) != 0 ||
+        fread(&indexOffset, sizeof(indexOffset), 1, fp) != 1 ||
+        fread(&count, sizeof(count), 1, fp) != 1 ||
+        fread(magic, 1, 8, fp) != 8 || memcmp(magic, "SNAPINDX", 8) != 0 ||
+        iframe < 0 || (uint64_t)iframe >= count)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    SnapEntry e;
+    SnapFrame f;
+    fseek(fp, (long)(indexOffset + iframe * sizeof(SnapEntry)), SEEK_SET);
+
+    if (fread(&e, sizeof(e), 1, fp) != 1) count = 0;
+
+    fseek(fp, (long)e.offset, SEEK_SET);
+
+    if (count == 0 || fread(&f, sizeof(f), 1, fp) != 1)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    if (istep) *istep = f.istep;
+
+    if (nx) *nx = f.nx;
+
+    if (ny) *ny = f.ny;
+
+    if (dst != NULL)
+    {
+        size_t n = (size_t)f.nx * f.ny;
+        unsigned char *in = (unsigned char *)malloc(f.nbytes);
+        unsigned char *planes = (unsigned char *)malloc(4 * n);
+
+        if (in == NULL || planes == NULL || fread(in, 1, f.nbytes, fp) !=
+                f.nbytes)
+            count = 0;
+        else
+            snapDecode(in, f.nbytes, n, f.mode, f.tol, planes, dst);
+
+        free(in);
+        free(planes);
+    }
+
+    fclose(fp);
+    return count == 0 ? -1 : (int)count;
+}
+
+#endif // _SNAPSHOT_H
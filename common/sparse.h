@@ -0,0 +1,776 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef _SPARSE_H
+#define _SPARSE_H
+
+/*
+ * Host sparse matrices: the cusparseSnnz / cusparseSdense2csr /
+ * cusparseScsrmv pipeline of cusparse.cu, in three storage formats.
+ *
+ *   CSR          rowPtr, colInd, val, as cuSPARSE builds it. One row at a
+ *                time; long rows run 8 entries per AVX2 gather.
+ *   SELL-C-sigma rows sorted by length within windows of SPARSE_SIGMA rows,
+ *                then cut into slices of SPARSE_C rows stored column by
+ *                column and padded to the longest row of the slice. A slice
+ *                is one row per SIMD lane, so short and uneven rows keep
+ *                every lane busy; the sort keeps the padding small.
+ *   BCSR         CSR of dense 4 x 4 blocks. One x load serves four rows
+ *                and the column index is read once per 16 values, which
+ *                pays when the non-zeros come in clusters.
+ *
+ * sparseDense2Csr converts a column-major dense matrix (cuSPARSE's layout)
+ * in two passes over blocks of rows on OpenMP threads: count the non-zeros
+ * of every row, prefix-sum the counts into rowPtr, then fill. Column
+ * indices come out sorted.
+ *
+ * sparseMatrixCreate looks at the row lengths of a CSR matrix and picks a
+ * format: BCSR if the 4 x 4 blocks store at most SPARSE_BCSR_FILL times the
+ * non-zeros, else SELL-C-sigma if its padding stays under SPARSE_SELL_FILL,
+ * else CSR, which keeps a few very long rows from padding whole slices.
+ * SELL gains most on many short rows, which leave CSR's gathers idle; on
+ * long rows of even length the two are level. sparseMv then computes
+ * y = alpha * A * x + beta * y in the chosen format; as in BLAS, y is not
+ * read when beta is zero. The functions returning int give 0 on success
+ * and -1 when out of memory.
+ */
+
+// rows per slice of SELL-C-sigma; one per lane of an AVX register
+#define SPARSE_C            8
+
+// rows sorted together by length
+#ifndef SPARSE_SIGMA
+#define SPARSE_SIGMA        256
+#endif
+
+// rows per block in the conversion passes
+#define SPARSE_ROWS         256
+
+#define SPARSE_B            4
+
+// format selection thresholds, stored over useful values
+#define SPARSE_BCSR_FILL    1.5
+#define SPARSE_SELL_FILL    1.25
+
+enum { SPARSE_CSR, SPARSE_SELL, SPARSE_BCSR };
+
+typedef struct
+{
+    int m, n, nnz;
+    int *rowPtr;            // m + 1
+    int *colInd;            // nnz
+    float *val;             // nnz
+} SparseCsr;
+
+typedef struct
+{
+    int m, n, nnz;
+    int nslices;
+    int *perm;              // row of each slice lane, -1 past m
+    int *sliceLen;          // longest row of each slice
+    int *slicePtr;          // first value of each slice, nslices + 1
+    int *colInd;
+    float *val;             // slice s, entry k, lane r at
+                            // slicePtr[s] + k * SPARSE_C + r
+} SparseSell;
+
+typedef struct
+{
+    int m, n, nnz;
+    int mb, nb;             // block rows and columns
+    int *rowPtr;            // mb + 1
+    int *colInd;            // block column of each block
+    float *val;             // 16 per block, column by column
+} SparseBcsr;
+
+typedef struct
+{
+    int format;
+    double meanRow;         // mean non-zeros per row
+    int maxRow;
+    double sellFill;        // stored values over non-zeros
+    double bcsrFill;
+    SparseCsr csr;
+    SparseSell sell;
+    SparseBcsr bcsr;
+} SparseMatrix;
+
+static inline const char *sparseFormatName(const int format)
+{
+    return format == SPARSE_BCSR ? "BCSR" : format == SPARSE_SELL ?
+           "SELL-C-sigma" : "CSR";
+}
+
+/*
+ * Non-zeros per row of the m x n column-major matrix A, like cusparseSnnz;
+ * returns the total. A block of rows reads a contiguous piece of every
+ * column.
+ */
+static inline int sparseNnz(const int m, const int n, const float *A,
+                            const int lda, int *nnzPerRow)
+{
+    const int nblk = (m + SPARSE_ROWS - 1) / SPARSE_ROWS;
+    int total = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+:total)
+    for (int b = 0; b < nblk; b++)
+    {
+        const int i0 = b * SPARSE_ROWS;
+        const int i1 = i0 + SPARSE_ROWS < m ? i0 + SPARSE_ROWS : m;
+
+        for (int i = i0; i < i1; i++) nnzPerRow[i] = 0;
+
+        for (int j = 0; j < n; j++)
+        {
+            const float *col = A + (size_t)j * lda;
+
+            for (int i = i0; i < i1; i++) nnzPerRow[i] += col[i] != 0.0f;
+        }
+
+        for (int i = i0; i < i1; i++) total += nnzPerRow[i];
+    }
+
+    return total;
+}
+
+/*
+ * rowPtr[0 .. m] = exclusive prefix sum of count[0 .. m - 1]: per-block
+ * sums, a serial scan over the blocks, then each block scanned from its
+ * offset.
+ */
+static inline void sparseScan(const int m, const int *count, int *rowPtr)
+{
+    const int nblk = (m + SPARSE_ROWS - 1) / SPARSE_ROWS;
+    int *off = (int *)malloc((nblk + 1) * sizeof(int));
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < nblk; b++)
+    {
+        const int i1 = (b + 1) * SPARSE_ROWS < m ? (b + 1) * SPARSE_ROWS : m;
+        int sum = 0;
+
+        for (int i = b * SPARSE_ROWS; i < i1; i++) sum += count[i];
+
+        off[b + 1] = sum;
+    }
+
+    off[0] = 0;
+
+    for (int b = 0; b < nblk; b++) off[b + 1] += off[b];
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < nblk; b++)
+    {
+        const int i1 = (b + 1) * SPARSE_ROWS < m ? (b + 1) * SPARSE_ROWS : m;
+        int sum = off[b];
+
+        for (int i = b * SPARSE_ROWS; i < i1; i++)
+        {
+            rowPtr[i] = sum;
+            sum += count[i];
+        }
+    }
+
+    rowPtr[m] = off[nblk];
+    free(off);
+}
+
+static inline void sparseCsrFree(SparseCsr *a)
+{
+    free(a->rowPtr);
+    free(a->colInd);
+    free(a->val);
+    memset(a, 0, sizeof(SparseCsr));
+}
+
+// the m x n column-major matrix A as CSR, like cusparseSdense2csr
+static inline int sparseDense2Csr(const int m, const int n, const float *A,
+                                  const int lda, SparseCsr *csr)
+{
+    const int nblk = (m + SPARSE_ROWS - 1) / SPARSE_ROWS;
+    int *count = (int *)malloc((m + 1) * sizeof(int));
+
+    memset(csr, 0, sizeof(SparseCsr));
+    csr->m = m;
+    csr->n = n;
+    csr->rowPtr = (int *)malloc((m + 1) * sizeof(int));
+
+    if (count == NULL || csr->rowPtr == NULL)
+    {
+        free(count);
+        sparseCsrFree(csr);
+        return -1;
+    }
+
+    // pass 1: count, then scan
+    csr->nnz = sparseNnz(m, n, A, lda, count);
+    sparseScan(m, count, csr->rowPtr);
+
+    csr->colInd = (int *)malloc((csr->nnz + 1) * sizeof(int));
+    csr->val    = (float *)malloc((csr->nnz + 1) * sizeof(float));
+
+    if (csr->colInd == NULL || csr->val == NULL)
+    {
+        free(count);
+        sparseCsrFree(csr);
+        return -1;
+    }
+
+    // pass 2: fill; count becomes the next free slot of each row
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < nblk; b++)
+    {
+        const int i0 = b * SPARSE_ROWS;
+        const int i1 = i0 + SPARSE_ROWS < m ? i0 + SPARSE_ROWS : m;
+        int *next = count;
+
+        for (int i = i0; i < i1; i++) next[i] = csr->rowPtr[i];
+
+        for (int j = 0; j < n; j++)
+        {
+            const float *col = A + (size_t)j * lda;
+
+            for (int i = i0; i < i1; i++)
+            {
+                if (col[i] != 0.0f)
+                {
+                    csr->colInd[next[i]] = j;
+                    csr->val[next[i]++]  = col[i];
+                }
+            }
+        }
+    }
+
+    free(count);
+    return 0;
+}
+
+// y[i] = alpha * t + beta * y[i], without reading y when beta is zero
+static inline float sparseAxpby(const float alpha, const float t,
+                                const float beta, const float y)
+{
+    return beta == 0.0f ? alpha * t : alpha * t + beta * y;
+}
+
+static inline float sparseCsrRow(const SparseCsr *a, const int i,
+                                 const float *x)
+{
+    int k = a->rowPtr[i];
+    const int k1 = a->rowPtr[i + 1];
+    float sum = 0.0f;
+
+#if defined(__AVX2__)
+    if (k1 - k >= 16)
+    {
+        __m256 acc = _mm256_setzero_ps();
+
+        for (; k + 8 <= k1; k += 8)
+        {
+            __m256i idx = _mm256_loadu_si256((const __m256i *)(a->colInd + k));
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a->val + k),
+                                _mm256_i32gather_ps(x, idx, 4)));
+        }
+
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc),
+                              _mm256_extractf128_ps(acc, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        sum = _mm_cvtss_f32(s);
+    }
+#endif
+
+    for (; k < k1; k++) sum += a->val[k] * x[a->colInd[k]];
+
+    return sum;
+}
+
+// y = alpha * A * x + beta * y, like cusparseScsrmv
+static inline void sparseCsrMv(const SparseCsr *a, const float alpha,
+                               const float *x, const float beta, float *y)
+{
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < a->m; i++)
+    {
+        y[i] = sparseAxpby(alpha, sparseCsrRow(a, i, x), beta, y[i]);
+    }
+}
+
+static inline void sparseSellFree(SparseSell *s)
+{
+    free(s->perm);
+    free(s->sliceLen);
+    free(s->slicePtr);
+    free(s->colInd);
+    free(s->val);
+    memset(s, 0, sizeof(SparseSell));
+}
+
+typedef struct
+{
+    int len, row;
+} SparseRowLen;
+
+// longest first, then by row, so the order is the same on every run
+static inline int sparseByLength(const void *a, const void *b)
+{
+    const SparseRowLen *p = (const SparseRowLen *)a;
+    const SparseRowLen *q = (const SparseRowLen *)b;
+
+    if (p->len != q->len) return q->len - p->len;
+
+    return p->row - q->row;
+}
+
+// row order of SELL-C-sigma and the slice lengths; returns stored values
+static inline long sparseSellPlan(const SparseCsr *a, int *perm,
+                                  int *sliceLen)
+{
+    const int nslices = (a->m + SPARSE_C - 1) / SPARSE_C;
+    const int nwin = (a->m + SPARSE_SIGMA - 1) / SPARSE_SIGMA;
+    long stored = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+:stored)
+    for (int w = 0; w < nwin; w++)
+    {
+        SparseRowLen key[SPARSE_SIGMA];
+        const int r0 = w * SPARSE_SIGMA;
+        const int nr = r0 + SPARSE_SIGMA < a->m ? SPARSE_SIGMA : a->m - r0;
+
+        for (int r = 0; r < nr; r++)
+        {
+            key[r].row = r0 + r;
+            key[r].len = a->rowPtr[r0 + r + 1] - a->rowPtr[r0 + r];
+        }
+
+        qsort(key, nr, sizeof(SparseRowLen), sparseByLength);
+
+        // SPARSE_SIGMA is a multiple of SPARSE_C, so windows hold whole
+        // slices; past m the lanes are empty
+        for (int s = r0 / SPARSE_C; s < nslices &&
+                s < (r0 + SPARSE_SIGMA) / SPARSE_C; s++)
+        {
+            int len = 0;
+
+            for (int r = 0; r < SPARSE_C; r++)
+            {
+                int k = s * SPARSE_C + r - r0;
+
+                if (k < nr)
+                {
+                    perm[s * SPARSE_C + r] = key[k].row;
+
+                    if (key[k].len > len) len = key[k].len;
+                }
+                else
+                {
+                    perm[s * SPARSE_C + r] = -1;
+                }
+            }
+
+            sliceLen[s] = len;
+            stored += (long)len * SPARSE_C;
+        }
+    }
+
+    return stored;
+}
+
+static inline int sparseSellFromCsr(const SparseCsr *a, SparseSell *s)
+{
+    memset(s, 0, sizeof(SparseSell));
+    s->m = a->m;
+    s->n = a->n;
+    s->nnz = a->nnz;
+    s->nslices  = (a->m + SPARSE_C - 1) / SPARSE_C;
+    s->perm     = (int *)malloc((size_t)s->nslices * SPARSE_C * sizeof(int));
+    s->sliceLen = (int *)malloc((s->nslices + 1) * sizeof(int));
+    s->slicePtr = (int *)malloc((s->nslices + 1) * sizeof(int));
+
+    if (s->perm == NULL || s->sliceLen == NULL || s->slicePtr == NULL)
+    {
+        sparseSellFree(s);
+        return -1;
+    }
+
+    sparseSellPlan(a, s->perm, s->sliceLen);
+
+    s->slicePtr[0] = 0;
+
+    for (int i = 0; i < s->nslices; i++)
+        s->slicePtr[i + 1] = s->slicePtr[i] + s->sliceLen[i] * SPARSE_C;
+
+    const int stored = s->slicePtr[s->nslices];
+    s->colInd = (int *)malloc((stored + 1) * sizeof(int));
+    s->val    = (float *)malloc((stored + 1) * sizeof(float));
+
+    if (s->colInd == NULL || s->val == NULL)
+    {
+        sparseSellFree(s);
+        return -1;
+    }
+
+    // padding multiplies x[0] by zero
+    #pragma omp parallel for schedule(static)
+    for (int sl = 0; sl < s->nslices; sl++)
+    {
+        for (int r = 0; r < SPARSE_C; r++)
+        {
+            const int row = s->perm[sl * SPARSE_C + r];
+            const int k0 = row < 0 ? 0 : a->rowPtr[row];
+            const int len = row < 0 ? 0 : a->rowPtr[row + 1] - k0;
+            int *col = s->colInd + s->slicePtr[sl] + r;
+            float *val = s->val + s->slicePtr[sl] + r;
+
+            for (int k = 0; k < s->sliceLen[sl]; k++)
+            {
+                col[k * SPARSE_C] = k < len ? a->colInd[k0 + k] : 0;
+                val[k * SPARSE_C] = k < len ? a->val[k0 + k] : 0.0f;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static inline void sparseSellMv(const SparseSell *s, const float alpha,
+                                const float *x, const float beta, float *y)
+{
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int sl = 0; sl < s->nslices; sl++)
+    {
+        const int *col = s->colInd + s->slicePtr[sl];
+        const float *val = s->val + s->slicePtr[sl];
+        const int len = s->sliceLen[sl];
+        float sum[SPARSE_C];
+
+#if defined(__AVX2__)
+        __m256 acc = _mm256_setzero_ps();
+
+        for (int k = 0; k < len; k++)
+        {
+            __m256i idx = _mm256_loadu_si256((const __m256i *)(col + k *
+                                             SPARSE_C));
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(val + k *
+                                SPARSE_C), _mm256_i32gather_ps(x, idx, 4)));
+        }
+
+        _mm256_storeu_ps(sum, acc);
+#else
+        for (int r = 0; r < SPARSE_C; r++) sum[r] = 0.0f;
+
+        for (int k = 0; k < len; k++)
+        {
+            for (int r = 0; r < SPARSE_C; r++)
+                sum[r] += val[k * SPARSE_C + r] * x[col[k * SPARSE_C + r]];
+        }
+#endif
+
+        for (int r = 0; r < SPARSE_C; r++)
+        {
+            const int row = s->perm[sl * SPARSE_C + r];
+
+            if (row >= 0) y[row] = sparseAxpby(alpha, sum[r], beta, y[row]);
+        }
+    }
+}
+
+static inline void sparseBcsrFree(SparseBcsr *b)
+{
+    free(b->rowPtr);
+    free(b->colInd);
+    free(b->val);
+    memset(b, 0, sizeof(SparseBcsr));
+}
+
+static inline int sparseCompareInt(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * The sorted block columns of block row bi into cols (at most nb), using
+ * mark (nb entries, all below stamp) to see each block column once.
+ * Returns their number.
+ */
+static inline int sparseBlockCols(const SparseCsr *a, const int bi,
+                                  int *mark, const int stamp, int *cols)
+{
+    const int i1 = (bi + 1) * SPARSE_B < a->m ? (bi + 1) * SPARSE_B : a->m;
+    int nc = 0;
+
+    for (int i = bi * SPARSE_B; i < i1; i++)
+    {
+        for (int k = a->rowPtr[i]; k < a->rowPtr[i + 1]; k++)
+        {
+            const int bc = a->colInd[k] / SPARSE_B;
+
+            if (mark[bc] != stamp)
+            {
+                mark[bc] = stamp;
+                cols[nc++] = bc;
+            }
+        }
+    }
+
+    qsort(cols, nc, sizeof(int), sparseCompareInt);
+    return nc;
+}
+
+// blocks per block row into count; returns the total
+static inline long sparseBcsrPlan(const SparseCsr *a, int *count)
+{
+    const int mb = (a->m + SPARSE_B - 1) / SPARSE_B;
+    const int nb = (a->n + SPARSE_B - 1) / SPARSE_B;
+    long total = 0;
+
+    #pragma omp parallel reduction(+:total)
+    {
+        int *mark = (int *)malloc(2 * nb * sizeof(int));
+        int *cols = mark + nb;
+
+        for (int j = 0; j < nb; j++) mark[j] = -1;
+
+        #pragma omp for schedule(static)
+        for (int bi = 0; bi < mb; bi++)
+        {
+            count[bi] = sparseBlockCols(a, bi, mark, bi, cols);
+            total += count[bi];
+        }
+
+        free(mark);
+    }
+
+    return total;
+}
+
+static inline int sparseBcsrFromCsr(const SparseCsr *a, SparseBcsr *b)
+{
+    memset(b, 0, sizeof(SparseBcsr));
+    b->m = a->m;
+    b->n = a->n;
+    b->nnz = a->nnz;
+    b->mb = (a->m + SPARSE_B - 1) / SPARSE_B;
+    b->nb = (a->n + SPARSE_B - 1) / SPARSE_B;
+
+    int *count = (int *)malloc((b->mb + 1) * sizeof(int));
+    b->rowPtr = (int *)malloc((b->mb + 1) * sizeof(int));
+
+    if (count == NULL || b->rowPtr == NULL)
+    {
+        free(count);
+        sparseBcsrFree(b);
+        return -1;
+    }
+
+    sparseBcsrPlan(a, count);
+    sparseScan(b->mb, count, b->rowPtr);
+    free(count);
+
+    const int nblocks = b->rowPtr[b->mb];
+    b->colInd = (int *)malloc((nblocks + 1) * sizeof(int));
+    b->val = (float *)calloc((size_t)(nblocks + 1) * SPARSE_B * SPARSE_B,
+                             sizeof(float));
+
+    if (b->colInd == NULL || b->val == NULL)
+    {
+        sparseBcsrFree(b);
+        return -1;
+    }
+
+    #pragma omp parallel
+    {
+        // mark, then the block columns, then each one's place in the row
+        int *mark = (int *)malloc(3 * b->nb * sizeof(int));
+        int *cols = mark + b->nb, *slot = cols + b->nb;
+
+        for (int j = 0; j < b->nb; j++) mark[j] = -1;
+
+        #pragma omp for schedule(static)
+        for (int bi = 0; bi < b->mb; bi++)
+        {
+            const int base = b->rowPtr[bi];
+            const int nc = sparseBlockCols(a, bi, mark, bi, cols);
+            const int i1 = (bi + 1) * SPARSE_B < a->m ? (bi + 1) * SPARSE_B :
+                           a->m;
+
+            for (int c = 0; c < nc; c++)
+            {
+                b->colInd[base + c] = cols[c];
+                slot[cols[c]] = base + c;
+            }
+
+            for (int i = bi * SPARSE_B; i < i1; i++)
+            {
+                for (int k = a->rowPtr[i]; k < a->rowPtr[i + 1]; k++)
+                {
+                    const int j = a->colInd[k];
+                    float *blk = b->val + (size_t)slot[j / SPARSE_B] *
+                                 SPARSE_B * SPARSE_B;
+                    blk[(j % SPARSE_B) * SPARSE_B + i % SPARSE_B] = a->val[k];
+                }
+            }
+        }
+
+        free(mark);
+    }
+
+    return 0;
+}
+
+static inline void sparseBcsrMv(const SparseBcsr *b, const float alpha,
+                                const float *x, const float beta, float *y)
+{
+    // the last block column may hang over the end of x
+    const int ragged = b->n % SPARSE_B != 0;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int bi = 0; bi < b->mb; bi++)
+    {
+        float sum[SPARSE_B];
+
+#if defined(__SSE2__)
+        __m128 acc = _mm_setzero_ps();
+
+        for (int k = b->rowPtr[bi]; k < b->rowPtr[bi + 1]; k++)
+        {
+            const float *blk = b->val + (size_t)k * SPARSE_B * SPARSE_B;
+            const int j0 = b->colInd[k] * SPARSE_B;
+
+            for (int c = 0; c < SPARSE_B; c++)
+            {
+                if (ragged && j0 + c >= b->n) break;
+
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(blk + c *
+                                 SPARSE_B), _mm_set1_ps(x[j0 + c])));
+            }
+        }
+
+        _mm_storeu_ps(sum, acc);
+#else
+        for (int r = 0; r < SPARSE_B; r++) sum[r] = 0.0f;
+
+        for (int k = b->rowPtr[bi]; k < b->rowPtr[bi + 1]; k++)
+        {
+            const float *blk = b->val + (size_t)k * SPARSE_B * SPARSE_B;
+            const int j0 = b->colInd[k] * SPARSE_B;
+
+            for (int c = 0; c < SPARSE_B && j0 + c < b->n; c++)
+            {
+                for (int r = 0; r < SPARSE_B; r++)
+                    sum[r] += blk[c * SPARSE_B + r] * x[j0 + c];
+            }
+        }
+#endif
+
+        for (int r = 0; r < SPARSE_B && bi * SPARSE_B + r < b->m; r++)
+        {
+            const int i = bi * SPARSE_B + r;
+            y[i] = sparseAxpby(alpha, sum[r], beta, y[i]);
+        }
+    }
+}
+
+/*
+ * Choose a format for csr from its row lengths and the fill of the other
+ * formats, and build it. The matrix keeps its own copy of csr's arrays.
+ */
+static inline int sparseMatrixCreate(SparseMatrix *mat, const SparseCsr *csr,
+                                     int format)
+{
+    const int m = csr->m;
+    const int mb = (m + SPARSE_B - 1) / SPARSE_B;
+    const int nslices = (m + SPARSE_C - 1) / SPARSE_C;
+
+    memset(mat, 0, sizeof(SparseMatrix));
+
+    int *perm = (int *)malloc((size_t)nslices * SPARSE_C * sizeof(int));
+    int *tmp = (int *)malloc(((mb > nslices ? mb : nslices) + 1) *
+                             sizeof(int));
+
+    if (perm == NULL || tmp == NULL)
+    {
+        free(perm);
+        free(tmp);
+        return -1;
+    }
+
+    int maxRow = 0;
+
+    for (int i = 0; i < m; i++)
+    {
+        const int len = csr->rowPtr[i + 1] - csr->rowPtr[i];
+
+        if (len > maxRow) maxRow = len;
+    }
+
+    const double nnz = csr->nnz > 0 ? (double)csr->nnz : 1.0;
+    mat->meanRow  = m > 0 ? (double)csr->nnz / m : 0.0;
+    mat->maxRow   = maxRow;
+    mat->sellFill = sparseSellPlan(csr, perm, tmp) / nnz;
+    mat->bcsrFill = sparseBcsrPlan(csr, tmp) * (double)(SPARSE_B * SPARSE_B)
+                    / nnz;
+    free(perm);
+    free(tmp);
+
+    // format < 0: choose
+    if (format < 0)
+    {
+        if (mat->bcsrFill <= SPARSE_BCSR_FILL)
+            format = SPARSE_BCSR;
+        else if (mat->sellFill <= SPARSE_SELL_FILL)
+            format = SPARSE_SELL;
+        else
+            format = SPARSE_CSR;
+    }
+
+    mat->format = format;
+
+    if (format == SPARSE_SELL) return sparseSellFromCsr(csr, &mat->sell);
+
+    if (format == SPARSE_BCSR) return sparseBcsrFromCsr(csr, &mat->bcsr);
+
+    SparseCsr *a = &mat->csr;
+    *a = *csr;
+    a->rowPtr = (int *)malloc((m + 1) * sizeof(int));
+    a->colInd = (int *)malloc((csr->nnz + 1) * sizeof(int));
+    a->val    = (float *)malloc((csr->nnz + 1) * sizeof(float));
+
+    if (a->rowPtr == NULL || a->colInd == NULL || a->val == NULL)
+    {
+        sparseCsrFree(a);
+        return -1;
+    }
+
+    memcpy(a->rowPtr, csr->rowPtr, (m + 1) * sizeof(int));
+    memcpy(a->colInd, csr->colInd, csr->nnz * sizeof(int));
+    memcpy(a->val, csr->val, csr->nnz * sizeof(float));
+    return 0;
+}
+
+static inline void sparseMv(const SparseMatrix *mat, const float alpha,
+                            const float *x, const float beta, float *y)
+{
+    if (mat->format == SPARSE_SELL)
+        sparseSellMv(&mat->sell, alpha, x, beta, y);
+    else if (mat->format == SPARSE_BCSR)
+        sparseBcsrMv(&mat->bcsr, alpha, x, beta, y);
+    else
+        sparseCsrMv(&mat->csr, alpha, x, beta, y);
+}
+
+static inline void sparseMatrixFree(SparseMatrix *mat)
+{
+    sparseCsrFree(&mat->csr);
+    sparseSellFree(&mat->sell);
+    sparseBcsrFree(&mat->bcsr);
+}
+
+#endif // _SPARSE_H
@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef _STENCIL_H
+#define _STENCIL_H
+
+/*
+ * Host finite-difference stencils with a radius R and coefficients
+ * coef[0..R], the host side of the __constant__ coef arrays in
+ * constantStencil.cu and simple2DFD.cu.
+ *
+ *   stencil1d       out[i] = coef[0] * in[i]
+ *                          + sum_d coef[d] * (in[i + d] + in[i - d])
+ *                   or, STENCIL_ODD (a first derivative, as in
+ *                   constantStencil.cu),
+ *                   out[i] = sum_d coef[d] * (in[i + d] - in[i - d])
+ *   stencil2d       one row of the 2D star of simple2DFD.cu,
+ *                   L(p) = 2 coef[0] p + sum_d coef[d] * (x and y pairs)
+ *   stencilWave2d   one row of kernel_2dfd's time step,
+ *                   u1 = 2 u2 - u1 + alpha * L(u2)
+ *
+ * All run 8 points at a time in AVX registers (4 in SSE registers), with a
+ * scalar loop for the rest, and read R points or rows beyond the range
+ * they write. They are static inline, and the loops over the radius are
+ * marked for unrolling, so that a call with a literal R compiles to
+ * straight-line code with the coefficients in registers, as a template
+ * would. The 2D functions do the same floating-point operations in the same
+ * order as kernel_2dfd.
+ *
+ * stencilParallel splits a range of points or rows into one contiguous
+ * chunk per POSIX thread. The chunks read each other's first and last R
+ * points (the halo) but write only their own, so nothing is copied or
+ * exchanged; stencilApply1d and stencilApply2d run the kernels this way.
+ */
+
+#define STENCIL_MAX_RADIUS  8
+
+#define STENCIL_EVEN        0
+#define STENCIL_ODD         1
+
+// 1D chunks start on a cache line, so no two threads write the same one
+#define STENCIL_GRAIN       16
+
+static inline void stencil1d(float *out, const float *in, const int lo,
+                             const int hi, const int R, const float *coef,
+                             const int parity)
+{
+    int i = lo;
+
+#if defined(__AVX__)
+    __m256 c[STENCIL_MAX_RADIUS + 1];
+
+    for (int d = 0; d <= R; d++) c[d] = _mm256_set1_ps(coef[d]);
+
+    for (; i + 8 <= hi; i += 8)
+    {
+        const float *p = in + i;
+        __m256 tmp = parity == STENCIL_ODD ? _mm256_setzero_ps() :
+                     _mm256_mul_ps(c[0], _mm256_loadu_ps(p));
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++)
+        {
+            __m256 l = _mm256_loadu_ps(p - d), r = _mm256_loadu_ps(p + d);
+            tmp = _mm256_add_ps(tmp, _mm256_mul_ps(c[d], parity == STENCIL_ODD
+                                ? _mm256_sub_ps(r, l) : _mm256_add_ps(l, r)));
+        }
+
+        _mm256_storeu_ps(out + i, tmp);
+    }
+#elif defined(__SSE2__)
+    __m128 c[STENCIL_MAX_RADIUS + 1];
+
+    for (int d = 0; d <= R; d++) c[d] = _mm_set1_ps(coef[d]);
+
+    for (; i + 4 <= hi; i += 4)
+    {
+        const float *p = in + i;
+        __m128 tmp = parity == STENCIL_ODD ? _mm_setzero_ps() :
+                     _mm_mul_ps(c[0], _mm_loadu_ps(p));
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++)
+        {
+            __m128 l = _mm_loadu_ps(p - d), r = _mm_loadu_ps(p + d);
+            tmp = _mm_add_ps(tmp, _mm_mul_ps(c[d], parity == STENCIL_ODD ?
+                             _mm_sub_ps(r, l) : _mm_add_ps(l, r)));
+        }
+
+        _mm_storeu_ps(out + i, tmp);
+    }
+#endif
+
+    for (; i < hi; i++)
+    {
+        const float *p = in + i;
+        float tmp = parity == STENCIL_ODD ? 0.0f : coef[0] * p[0];
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++)
+        {
+            tmp += coef[d] * (parity == STENCIL_ODD ? p[d] - p[-d] :
+                              p[-d] + p[d]);
+        }
+
+        out[i] = tmp;
+    }
+}
+
+/*
+ * The 2D kernels share one loop: points x0 <= ix < x1 of the row at in,
+ * whose neighbours are -+nx away. wave selects the kernel_2dfd update of
+ * out (u1) over the plain stencil.
+ */
+static inline void stencilRow2d(float *out, const float *in, const int nx,
+                                const int x0, const int x1, const int R,
+                                const float *coef, const int wave,
+                                const float alpha)
+{
+    int ix = x0;
+
+#if defined(__AVX__)
+    __m256 c[STENCIL_MAX_RADIUS + 1];
+    const __m256 two = _mm256_set1_ps(2.0f), va = _mm256_set1_ps(alpha);
+
+    for (int d = 0; d <= R; d++) c[d] = _mm256_set1_ps(coef[d]);
+
+    for (; ix + 8 <= x1; ix += 8)
+    {
+        const float *p = in + ix;
+        __m256 v = _mm256_loadu_ps(p);
+        __m256 tmp = _mm256_mul_ps(_mm256_mul_ps(c[0], v), two);
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++)
+        {
+            tmp = _mm256_add_ps(tmp, _mm256_mul_ps(c[d], _mm256_add_ps(
+                        _mm256_loadu_ps(p - d), _mm256_loadu_ps(p + d))));
+        }
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++)
+        {
+            tmp = _mm256_add_ps(tmp, _mm256_mul_ps(c[d], _mm256_add_ps(
+                        _mm256_loadu_ps(p - d * nx),
+                        _mm256_loadu_ps(p + d * nx))));
+        }
+
+        if (wave)
+        {
+            __m256 r = _mm256_sub_ps(_mm256_add_ps(v, v),
+                                     _mm256_loadu_ps(out + ix));
+            tmp = _mm256_add_ps(r, _mm256_mul_ps(va, tmp));
+        }
+
+        _mm256_storeu_ps(out + ix, tmp);
+    }
+#elif defined(__SSE2__)
+    __m128 c[STENCIL_MAX_RADIUS + 1];
+    const __m128 two = _mm_set1_ps(2.0f), va = _mm_set1_ps(alpha);
+
+    for (int d = 0; d <= R; d++) c[d] = _mm_set1_ps(coef[d]);
+
+    for (; ix + 4 <= x1; ix += 4)
+    {
+        const float *p = in + ix;
+        __m128 v = _mm_loadu_ps(p);
+        __m128 tmp = _mm_mul_ps(_mm_mul_ps(c[0], v), two);
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++)
+        {
+            tmp = _mm_add_ps(tmp, _mm_mul_ps(c[d], _mm_add_ps(
+                        _mm_loadu_ps(p - d), _mm_loadu_ps(p + d))));
+        }
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++)
+        {
+            tmp = _mm_add_ps(tmp, _mm_mul_ps(c[d], _mm_add_ps(
+                        _mm_loadu_ps(p - d * nx), _mm_loadu_ps(p + d * nx))));
+        }
+
+        if (wave)
+        {
+            __m128 r = _mm_sub_ps(_mm_add_ps(v, v), _mm_loadu_ps(out + ix));
+            tmp = _mm_add_ps(r, _mm_mul_ps(va, tmp));
+        }
+
+        _mm_storeu_ps(out + ix, tmp);
+    }
+#endif
+
+    for (; ix < x1; ix++)
+    {
+        const float *p = in + ix;
+        float tmp = coef[0] * p[0] * 2.0f;
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++) tmp += coef[d] * (p[-d] + p[d]);
+
+#pragma GCC unroll 8
+        for (int d = 1; d <= R; d++) tmp += coef[d] * (p[-d * nx] + p[d * nx]);
+
+        out[ix] = wave ? p[0] + p[0] - out[ix] + alpha * tmp : tmp;
+    }
+}
+
+static inline void stencil2d(float *out, const float *in, const int nx,
+                             const int x0, const int x1, const int R,
+                             const float *coef)
+{
+    stencilRow2d(out, in, nx, x0, x1, R, coef, 0, 0.0f);
+}
+
+static inline void stencilWave2d(float *u1, const float *u2, const int nx,
+                                 const int x0, const int x1, const int R,
+                                 const float *coef, const float alpha)
+{
+    stencilRow2d(u1, u2, nx, x0, x1, R, coef, 1, alpha);
+}
+
+// fn(arg, lo, hi) computes points or rows [lo, hi)
+typedef void (*StencilRange)(void *arg, int lo, int hi);
+
+typedef struct
+{
+    StencilRange fn;
+    void *arg;
+    int lo, hi;
+} StencilJob;
+
+static inline void *stencilWorker(void *arg)
+{
+    StencilJob *job = (StencilJob *)arg;
+
+    if (job->lo < job->hi) job->fn(job->arg, job->lo, job->hi);
+
+    return NULL;
+}
+
+// start of chunk i of n over [lo, hi), rounded up to a multiple of grain
+static inline int stencilSplit(const int lo, const int hi, const int i,
+                               const int n, const int grain)
+{
+    if (i == 0) return lo;
+
+    long b = lo + ((long)hi - lo) * i / n;
+    b = (b + grain - 1) / grain * grain;
+
+    return b < hi ? (int)b : hi;
+}
+
+static inline void stencilParallel(StencilRange fn, void *arg, const int lo,
+                                   const int hi, int nthreads,
+                                   const int grain)
+{
+    if (nthreads < 1) nthreads = 1;
+
+    pthread_t *tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    StencilJob *job = (StencilJob *)malloc(nthreads * sizeof(StencilJob));
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        job[i].fn  = fn;
+        job[i].arg = arg;
+        job[i].lo  = stencilSplit(lo, hi, i, nthreads, grain);
+        job[i].hi  = stencilSplit(lo, hi, i + 1, nthreads, grain);
+
+        if (i > 0) pthread_create(&tid[i], NULL, stencilWorker, &job[i]);
+    }
+
+    stencilWorker(&job[0]);
+
+    for (int i = 1; i < nthreads; i++) pthread_join(tid[i], NULL);
+
+    free(tid);
+    free(job);
+}
+
+typedef struct
+{
+    float *out;
+    const float *in;
+    int nx, R, parity;
+    const float *coef;
+} StencilArgs;
+
+/*
+ * The radii the samples use get their own call with a literal R, so they
+ * are unrolled even though R is only known at run time here.
+ */
+static inline void stencilRange1d(void *arg, int lo, int hi)
+{
+    StencilArgs *a = (StencilArgs *)arg;
+
+    switch (a->R)
+    {
+    case 2:
+        stencil1d(a->out, a->in, lo, hi, 2, a->coef, a->parity);
+        break;
+
+    case 4:
+        stencil1d(a->out, a->in, lo, hi, 4, a->coef, a->parity);
+        break;
+
+    default:
+        stencil1d(a->out, a->in, lo, hi, a->R, a->coef, a->parity);
+    }
+}
+
+static inline void stencilRange2d(void *arg, int lo, int hi)
+{
+    StencilArgs *a = (StencilArgs *)arg;
+    const int nx = a->nx, R = a->R;
+
+    for (int iy = lo; iy < hi; iy++)
+    {
+        float *out = a->out + (size_t)iy * nx;
+        const float *in = a->in + (size_t)iy * nx;
+
+        if (R == 4)
+            stencil2d(out, in, nx, 4, nx - 4, 4, a->coef);
+        else
+            stencil2d(out, in, nx, R, nx - R, R, a->coef);
+    }
+}
+
+// stencil1d over [lo, hi) on nthreads threads
+static inline void stencilApply1d(float *out, const float *in, const int lo,
+                                  const int hi, const int R,
+                                  const float *coef, const int parity,
+                                  const int nthreads)
+{
+    StencilArgs a = { out, in, 0, R, parity, coef };
+
+    stencilParallel(stencilRange1d, &a, lo, hi, nthreads, STENCIL_GRAIN);
+}
+
+// stencil2d over the interior of an nx x ny grid, R from every edge
+static inline void stencilApply2d(float *out, const float *in, const int nx,
+                                  const int ny, const int R,
+                                  const float *coef, const int nthreads)
+{
+    StencilArgs a = { out, in, nx, R, STENCIL_EVEN, coef };
+
+    stencilParallel(stencilRange2d, &a, R, ny - R, nthreads, 1);
+}
+
+#endif // _STENCIL_H
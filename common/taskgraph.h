@@ -0,0 +1,588 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#ifndef _TASKGRAPH_H
+#define _TASKGRAPH_H
+
+/*
+ * Host task graph with the shape of the CUDA stream API the samples in
+ * 6streamsConcurrency use:
+ *
+ *   CUDA                          here
+ *   cudaStreamCreate              taskStreamCreate(pool)
+ *   kernel<<<g, b, 0, stream>>>   taskLaunch(stream, fn, arg)
+ *   cudaEventRecord               taskEventRecord(event, stream)
+ *   cudaStreamWaitEvent           taskStreamWaitEvent(stream, event)
+ *   cudaStreamAddCallback         taskStreamAddCallback(stream, cb, data)
+ *   cudaEventElapsedTime          taskEventElapsedTime(start, stop)
+ *   cudaStreamSynchronize,        taskStreamSynchronize, taskEventSynchronize,
+ *   cudaEventSynchronize,         taskPoolSynchronize
+ *   cudaDeviceSynchronize
+ *
+ * Every call adds a node to a dependency graph: a node waits for the
+ * previous node of its stream and, for a wait, for the node an event last
+ * recorded. Records and waits are markers with no work of their own; they
+ * complete as soon as their dependencies do, which is also when an event
+ * takes its time stamp.
+ *
+ * Nodes whose dependencies are met run on a pool of POSIX threads. Each
+ * worker keeps a deque of ready nodes: it takes the newest of its own (the
+ * successor it just made ready, still warm in cache) and, when that is
+ * empty, steals the oldest from another worker. Nodes made ready by the
+ * submitting thread are dealt to the workers round robin.
+ *
+ * The pool counts, per worker, the nodes run, the nodes stolen and the
+ * time from a node becoming ready to starting (taskPoolStats), the
+ * scheduling latency of a submission order.
+ */
+
+typedef struct Task Task;
+typedef struct TaskPool TaskPool;
+typedef struct TaskStream TaskStream;
+typedef struct TaskEvent TaskEvent;
+
+typedef void (*TaskFn)(void *arg);
+typedef void (*TaskCallback)(TaskStream *stream, void *data);
+
+struct Task
+{
+    TaskFn fn;              // work, or NULL for a marker
+    TaskCallback cb;        // or a host callback
+    void *arg;
+    TaskStream *stream;
+
+    int refs;               // the graph, a stream's last node, events
+    int pending;            // unfinished dependencies, plus one while built
+    int done;
+    double ready;           // when pending reached zero
+    double time;            // when it finished
+    Task *next;             // markers finishing in one sweep
+
+    pthread_mutex_t lock;   // guards succ and done
+    Task **succ;
+    int nsucc, capsucc;
+};
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    Task **buf;
+    int cap, head, tail;    // ready nodes are buf[head .. tail) mod cap
+
+    // statistics, written by the owner only
+    long ntasks, nstolen;
+    double wait;
+} TaskDeque;
+
+typedef struct
+{
+    TaskPool *pool;
+    int id;
+} TaskWorker;
+
+struct TaskPool
+{
+    int nthreads;
+    pthread_t *tid;
+    TaskWorker *worker;
+    TaskDeque *deque;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // a node became ready
+    pthread_cond_t idle;    // a node finished
+    int queued;             // ready nodes in all deques
+    int sleepers;
+    int waiters;
+    int outstanding;        // submitted nodes not finished
+    int quit;
+    unsigned deal;          // next worker for nodes readied by the host
+};
+
+struct TaskStream
+{
+    TaskPool *pool;
+    Task *last;
+    pthread_mutex_t lock;
+};
+
+struct TaskEvent
+{
+    TaskPool *pool;
+    Task *task;             // the node last recorded, NULL before
+};
+
+static inline double taskSeconds(void)
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((double)tp.tv_sec + (double)tp.tv_usec * 1.e-6);
+}
+
+static inline void taskRelease(Task *t)
+{
+    if (t != NULL && __sync_sub_and_fetch(&t->refs, 1) == 0)
+    {
+        pthread_mutex_destroy(&t->lock);
+        free(t->succ);
+        free(t);
+    }
+}
+
+static inline int taskDone(Task *t)
+{
+    return __atomic_load_n(&t->done, __ATOMIC_ACQUIRE);
+}
+
+static inline void taskDequePush(TaskDeque *q, Task *t)
+{
+    pthread_mutex_lock(&q->lock);
+
+    if (q->tail - q->head == q->cap)
+    {
+        int cap = q->cap ? 2 * q->cap : 64;
+        Task **buf = (Task **)malloc(cap * sizeof(Task *));
+
+        for (int i = q->head; i < q->tail; i++)
+            buf[i - q->head] = q->buf[i % q->cap];
+
+        free(q->buf);
+        q->buf = buf;
+        q->cap = cap;
+        __atomic_store_n(&q->tail, q->tail - q->head, __ATOMIC_RELAXED);
+        __atomic_store_n(&q->head, 0, __ATOMIC_RELAXED);
+    }
+
+    q->buf[q->tail % q->cap] = t;
+    __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// the owner takes the newest node
+static inline Task *taskDequePop(TaskDeque *q)
+{
+    Task *t = NULL;
+
+    pthread_mutex_lock(&q->lock);
+
+    if (q->tail > q->head)
+    {
+        t = q->buf[(q->tail - 1) % q->cap];
+        __atomic_store_n(&q->tail, q->tail - 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+// a thief takes the oldest; head and tail are stored atomically so that
+// an empty deque can be passed over without taking its lock
+static inline Task *taskDequeSteal(TaskDeque *q)
+{
+    Task *t = NULL;
+
+    if (__atomic_load_n(&q->tail, __ATOMIC_RELAXED) ==
+            __atomic_load_n(&q->head, __ATOMIC_RELAXED))
+        return NULL;
+
+    pthread_mutex_lock(&q->lock);
+
+    if (q->tail > q->head)
+    {
+        t = q->buf[q->head % q->cap];
+        __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+// queue a ready node on worker w, or deal it out if w < 0 (the host)
+static inline void taskPush(TaskPool *p, Task *t, int w)
+{
+    if (w < 0) w = (int)(__sync_fetch_and_add(&p->deal, 1) % p->nthreads);
+
+    taskDequePush(&p->deque[w], t);
+
+    pthread_mutex_lock(&p->lock);
+    p->queued++;
+
+    if (p->sleepers > 0) pthread_cond_signal(&p->work);
+
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * Finish t and release its successors. Successors that are markers finish
+ * here as well, without going through a deque, so a chain of records and
+ * waits is walked in one loop rather than by recursion.
+ */
+static inline void taskFinish(TaskPool *p, Task *t, int w)
+{
+    t->next = NULL;
+
+    while (t != NULL)
+    {
+        Task *c = t;
+        t = c->next;
+
+        c->time = taskSeconds();
+
+        pthread_mutex_lock(&c->lock);
+        __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+        Task **succ = c->succ;
+        int nsucc = c->nsucc;
+        c->succ  = NULL;
+        c->nsucc = c->capsucc = 0;
+        pthread_mutex_unlock(&c->lock);
+
+        for (int i = 0; i < nsucc; i++)
+        {
+            Task *s = succ[i];
+
+            if (__sync_sub_and_fetch(&s->pending, 1) != 0) continue;
+
+            s->ready = c->time;
+
+            if (s->fn == NULL && s->cb == NULL)
+            {
+                s->next = t;
+                t = s;
+            }
+            else
+            {
+                taskPush(p, s, w);
+            }
+        }
+
+        free(succ);
+
+        pthread_mutex_lock(&p->lock);
+        p->outstanding--;
+
+        if (p->waiters > 0) pthread_cond_broadcast(&p->idle);
+
+        pthread_mutex_unlock(&p->lock);
+        taskRelease(c);
+    }
+}
+
+static inline void *taskWorkerMain(void *arg)
+{
+    TaskWorker *me = (TaskWorker *)arg;
+    TaskPool *p = me->pool;
+    TaskDeque *q = &p->deque[me->id];
+
+    for (;;)
+    {
+        int stolen = 0;
+        Task *t = taskDequePop(q);
+
+        for (int k = 1; t == NULL && k < p->nthreads; k++)
+        {
+            t = taskDequeSteal(&p->deque[(me->id + k) % p->nthreads]);
+            stolen = 1;
+        }
+
+        if (t != NULL)
+        {
+            pthread_mutex_lock(&p->lock);
+            p->queued--;
+            pthread_mutex_unlock(&p->lock);
+
+            double start = taskSeconds();
+            q->ntasks++;
+            q->nstolen += stolen;
+            q->wait += start - t->ready;
+
+            if (t->fn != NULL)
+                t->fn(t->arg);
+            else
+                t->cb(t->stream, t->arg);
+
+            taskFinish(p, t, me->id);
+            continue;
+        }
+
+        pthread_mutex_lock(&p->lock);
+
+        if (p->quit)
+        {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+
+        if (p->queued == 0)
+        {
+            p->sleepers++;
+            pthread_cond_wait(&p->work, &p->lock);
+            p->sleepers--;
+        }
+
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    return NULL;
+}
+
+static inline TaskPool *taskPoolCreate(int nthreads)
+{
+    if (nthreads < 1) nthreads = 1;
+
+    TaskPool *p = (TaskPool *)calloc(1, sizeof(TaskPool));
+    p->nthreads = nthreads;
+    p->tid      = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    p->worker   = (TaskWorker *)malloc(nthreads * sizeof(TaskWorker));
+    p->deque    = (TaskDeque *)calloc(nthreads, sizeof(TaskDeque));
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->idle, NULL);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_mutex_init(&p->deque[i].lock, NULL);
+        p->worker[i].pool = p;
+        p->worker[i].id   = i;
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_create(&p->tid[i], NULL, taskWorkerMain, &p->worker[i]);
+    }
+
+    return p;
+}
+
+// wait for every node submitted so far
+static inline void taskPoolSynchronize(TaskPool *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->waiters++;
+
+    while (p->outstanding > 0) pthread_cond_wait(&p->idle, &p->lock);
+
+    p->waiters--;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static inline void taskPoolDestroy(TaskPool *p)
+{
+    taskPoolSynchronize(p);
+
+    pthread_mutex_lock(&p->lock);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int i = 0; i < p->nthreads; i++) pthread_join(p->tid[i], NULL);
+
+    for (int i = 0; i < p->nthreads; i++)
+    {
+        pthread_mutex_destroy(&p->deque[i].lock);
+        free(p->deque[i].buf);
+    }
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->idle);
+    free(p->tid);
+    free(p->worker);
+    free(p->deque);
+    free(p);
+}
+
+// nodes run, of which stolen, and mean ready-to-start time in seconds
+static inline void taskPoolStats(TaskPool *p, long *ntasks, long *nstolen,
+                                 double *wait)
+{
+    long n = 0, s = 0;
+    double w = 0.0;
+
+    taskPoolSynchronize(p);
+
+    for (int i = 0; i < p->nthreads; i++)
+    {
+        n += p->deque[i].ntasks;
+        s += p->deque[i].nstolen;
+        w += p->deque[i].wait;
+    }
+
+    *ntasks  = n;
+    *nstolen = s;
+    *wait    = n > 0 ? w / n : 0.0;
+}
+
+static inline void taskPoolResetStats(TaskPool *p)
+{
+    taskPoolSynchronize(p);
+
+    for (int i = 0; i < p->nthreads; i++)
+    {
+        p->deque[i].ntasks  = 0;
+        p->deque[i].nstolen = 0;
+        p->deque[i].wait    = 0.0;
+    }
+}
+
+static inline Task *taskNew(TaskStream *s, TaskFn fn, TaskCallback cb,
+                            void *arg)
+{
+    Task *t = (Task *)calloc(1, sizeof(Task));
+    t->fn      = fn;
+    t->cb      = cb;
+    t->arg     = arg;
+    t->stream  = s;
+    t->refs    = 1;
+    t->pending = 1;
+    pthread_mutex_init(&t->lock, NULL);
+    return t;
+}
+
+// make t wait for pred, unless pred has finished
+static inline void taskDepend(Task *t, Task *pred)
+{
+    if (pred == NULL) return;
+
+    pthread_mutex_lock(&pred->lock);
+
+    if (!pred->done)
+    {
+        if (pred->nsucc == pred->capsucc)
+        {
+            pred->capsucc = pred->capsucc ? 2 * pred->capsucc : 4;
+            pred->succ = (Task **)realloc(pred->succ, pred->capsucc *
+                                          sizeof(Task *));
+        }
+
+        pred->succ[pred->nsucc++] = t;
+        __sync_fetch_and_add(&t->pending, 1);
+    }
+
+    pthread_mutex_unlock(&pred->lock);
+}
+
+// append t to stream s, after the stream's last node and after extra
+static inline void taskSubmit(TaskStream *s, Task *t, Task *extra)
+{
+    TaskPool *p = s->pool;
+
+    pthread_mutex_lock(&p->lock);
+    p->outstanding++;
+    pthread_mutex_unlock(&p->lock);
+
+    pthread_mutex_lock(&s->lock);
+    taskDepend(t, s->last);
+    taskDepend(t, extra);
+    __sync_fetch_and_add(&t->refs, 1);
+    taskRelease(s->last);
+    s->last = t;
+    pthread_mutex_unlock(&s->lock);
+
+    if (__sync_sub_and_fetch(&t->pending, 1) != 0) return;
+
+    t->ready = taskSeconds();
+
+    if (t->fn == NULL && t->cb == NULL)
+        taskFinish(p, t, -1);
+    else
+        taskPush(p, t, -1);
+}
+
+static inline TaskStream *taskStreamCreate(TaskPool *p)
+{
+    TaskStream *s = (TaskStream *)calloc(1, sizeof(TaskStream));
+    s->pool = p;
+    pthread_mutex_init(&s->lock, NULL);
+    return s;
+}
+
+static inline void taskLaunch(TaskStream *s, TaskFn fn, void *arg)
+{
+    taskSubmit(s, taskNew(s, fn, NULL, arg), NULL);
+}
+
+static inline void taskStreamAddCallback(TaskStream *s, TaskCallback cb,
+                                         void *data)
+{
+    taskSubmit(s, taskNew(s, NULL, cb, data), NULL);
+}
+
+// wait for node t, holding a reference to it
+static inline void taskWait(TaskPool *p, Task *t)
+{
+    if (t == NULL) return;
+
+    pthread_mutex_lock(&p->lock);
+    p->waiters++;
+
+    while (!taskDone(t)) pthread_cond_wait(&p->idle, &p->lock);
+
+    p->waiters--;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static inline void taskStreamSynchronize(TaskStream *s)
+{
+    pthread_mutex_lock(&s->lock);
+    Task *t = s->last;
+
+    if (t != NULL) __sync_fetch_and_add(&t->refs, 1);
+
+    pthread_mutex_unlock(&s->lock);
+
+    taskWait(s->pool, t);
+    taskRelease(t);
+}
+
+// unlike cudaStreamDestroy, waits for the stream's work, which may call back
+static inline void taskStreamDestroy(TaskStream *s)
+{
+    taskStreamSynchronize(s);
+    taskRelease(s->last);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+static inline TaskEvent *taskEventCreate(TaskPool *p)
+{
+    TaskEvent *e = (TaskEvent *)calloc(1, sizeof(TaskEvent));
+    e->pool = p;
+    return e;
+}
+
+static inline void taskEventRecord(TaskEvent *e, TaskStream *s)
+{
+    Task *t = taskNew(s, NULL, NULL, NULL);
+
+    __sync_fetch_and_add(&t->refs, 1);
+    taskSubmit(s, t, NULL);
+    taskRelease(e->task);
+    e->task = t;
+}
+
+static inline void taskStreamWaitEvent(TaskStream *s, TaskEvent *e)
+{
+    taskSubmit(s, taskNew(s, NULL, NULL, NULL), e->task);
+}
+
+static inline void taskEventSynchronize(TaskEvent *e)
+{
+    taskWait(e->pool, e->task);
+}
+
+// milliseconds between two recorded events, once both have completed
+static inline float taskEventElapsedTime(TaskEvent *start, TaskEvent *stop)
+{
+    taskEventSynchronize(start);
+    taskEventSynchronize(stop);
+    return (float)((stop->task->time - start->task->time) * 1e3);
+}
+
+static inline void taskEventDestroy(TaskEvent *e)
+{
+    taskRelease(e->task);
+    free(e);
+}
+
+#endif // _TASKGRAPH_H
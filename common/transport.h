@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef _TRANSPORT_H
+#define _TRANSPORT_H
+
+/*
+ * Local transports for exchanging halos between the domains of a host
+ * decomposition, with the pattern of simpleC2C.c: both ends post a send
+ * and a receive of the same size and wait for both (MPI_Isend, MPI_Irecv,
+ * MPI_Waitall), here one call to xferExchange.
+ *
+ *   XFER_THREAD   two single-producer single-consumer rings in the heap,
+ *                 for threads of one process
+ *   XFER_SHM      the same rings in POSIX shared memory (shm_open, mmap),
+ *                 for processes: xferPair is called before fork, and the
+ *                 name is unlinked at once, so the mapping goes when the
+ *                 last process holding it exits
+ *   XFER_SOCKET   a Unix stream socket pair, the kernel copying through
+ *                 its socket buffers
+ *
+ * A ring is XFER_RING bytes; the producer owns the head and the consumer
+ * the tail, each on a cache line of its own, published with release stores
+ * and read with acquire loads, so there is no lock and every byte is
+ * copied once in and once out. Each end keeps the last value it read of
+ * the other's index and reloads it only when that shows too little room or
+ * data for the call.
+ *
+ * A message larger than a ring or a socket buffer cannot be sent whole
+ * before the other end receives, so xferExchange moves what fits of the
+ * outgoing message and what has arrived of the incoming one in turn until
+ * both are complete. An end with nothing to do spins XFER_SPIN times and
+ * then yields the processor (for the rings) or waits in poll (for the
+ * socket); on a single processor it yields at once, since the other end
+ * cannot run while this one spins.
+ *
+ * The ring ends also hold the two ends of a socket pair that never carries
+ * data. The kernel closes a socket when its process exits, killed or not,
+ * so a ring end that waits checks its socket every XFER_CHECK yields and
+ * gives up once the other side has hung up and a last look at the ring
+ * brings nothing.
+ *
+ * Each end is closed once, by the thread or process using it; after a fork
+ * each process also closes the end it does not use, so that its socket
+ * does not keep the other end alive. A process releases the rings with the
+ * last end it closes.
+ *
+ * xferPair returns 0, or -1 when out of memory or when the system refuses
+ * the shared memory or the sockets; xferExchange returns 0, or -1 when the
+ * other end has closed or exited.
+ */
+
+typedef enum
+{
+    XFER_THREAD,
+    XFER_SHM,
+    XFER_SOCKET
+} XferKind;
+
+// bytes per ring, a power of two
+#ifndef XFER_RING
+#define XFER_RING       (1 << 20)
+#endif
+
+// empty polls before yielding
+#ifndef XFER_SPIN
+#define XFER_SPIN       4096
+#endif
+
+// yields between checks that the other end is still there
+#define XFER_CHECK      64
+
+#define XFER_LINE       64
+
+typedef struct
+{
+    size_t head;            // bytes written, by the producer
+    char pad0[XFER_LINE - sizeof(size_t)];
+    size_t tail;            // bytes read, by the consumer
+    char pad1[XFER_LINE - sizeof(size_t)];
+    char data[XFER_RING];
+} XferRing;
+
+typedef struct
+{
+    XferKind kind;
+    XferRing *tx, *rx;
+    size_t txTail, rxHead;  // last seen tail of tx and head of rx
+    int fd;                 // the data socket, or the liveness socket
+    int spin;
+
+    void *map;              // the rings of both ends
+    size_t mapLen;
+    int *open;              // ends open in this process
+} XferEnd;
+
+static inline void xferPause(void)
+{
+#if defined(__SSE2__)
+    _mm_pause();
+#endif
+}
+
+static inline const char *xferKindName(const XferKind kind)
+{
+    return kind == XFER_THREAD ? "thread ring" : kind == XFER_SHM ?
+           "shm ring" : "unix socket";
+}
+
+// copy up to len bytes into the ring; the number copied
+static inline size_t xferPush(XferEnd *e, const char *buf, size_t len)
+{
+    XferRing *r = e->tx;
+    const size_t head = r->head;
+
+    if (XFER_RING - (head - e->txTail) < len)
+        e->txTail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+    size_t room = XFER_RING - (head - e->txTail);
+    size_t at = head & (XFER_RING - 1);
+
+    if (len > room) len = room;
+
+    if (len == 0) return 0;
+
+    const size_t first = len < XFER_RING - at ? len : XFER_RING - at;
+
+    memcpy(r->data + at, buf, first);
+    memcpy(r->data, buf + first, len - first);
+    __atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+// copy up to len bytes out of the ring; the number copied
+static inline size_t xferPop(XferEnd *e, char *buf, size_t len)
+{
+    XferRing *r = e->rx;
+    const size_t tail = r->tail;
+
+    if (e->rxHead - tail < len)
+        e->rxHead = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    size_t avail = e->rxHead - tail;
+    size_t at = tail & (XFER_RING - 1);
+
+    if (len > avail) len = avail;
+
+    if (len == 0) return 0;
+
+    const size_t first = len < XFER_RING - at ? len : XFER_RING - at;
+
+    memcpy(buf, r->data + at, first);
+    memcpy(buf + first, r->data, len - first);
+    __atomic_store_n(&r->tail, tail + len, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+// the same for the socket: -1 when the other end has gone
+static inline long xferSend(XferEnd *e, const char *buf, size_t len)
+{
+    ssize_t n = send(e->fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+    return n;
+}
+
+static inline long xferRecv(XferEnd *e, char *buf, size_t len)
+{
+    ssize_t n = recv(e->fd, buf, len, MSG_DONTWAIT);
+
+    if (n == 0) return -1;
+
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+    return n;
+}
+
+/*
+ * Nothing moved in this round: spin a while, then give the processor up.
+ * Returns 1 when the other end of a ring has hung up.
+ */
+static inline int xferWait(XferEnd *e, int *idle, const int sending,
+                           const int receiving)
+{
+    if (++*idle <= e->spin)
+    {
+        xferPause();
+        return 0;
+    }
+
+    if (e->kind != XFER_SOCKET)
+    {
+        sched_yield();
+
+        if ((*idle - e->spin) % XFER_CHECK != 0) return 0;
+
+        // nothing is ever sent, so a readable socket is the hangup
+        struct pollfd p = { e->fd, POLLIN, 0 };
+
+        return poll(&p, 1, 0) > 0;
+    }
+
+    struct pollfd p = { e->fd, (short)((sending ? POLLOUT : 0) |
+                                       (receiving ? POLLIN : 0)), 0
+                      };
+
+    poll(&p, 1, 10);
+    return 0;
+}
+
+/*
+ * Send size bytes of sbuf to the other end while receiving size bytes
+ * from it into rbuf.
+ */
+static inline int xferExchange(XferEnd *e, const void *sbuf, void *rbuf,
+                               const size_t size)
+{
+    const char *s = (const char *)sbuf;
+    char *r = (char *)rbuf;
+    size_t sent = 0, recvd = 0;
+    int idle = 0, gone = 0;
+
+    while (sent < size || recvd < size)
+    {
+        long ns = 0, nr = 0;
+
+        if (e->kind == XFER_SOCKET)
+        {
+            if (sent < size) ns = xferSend(e, s + sent, size - sent);
+
+            if (recvd < size) nr = xferRecv(e, r + recvd, size - recvd);
+
+            if (ns < 0 || nr < 0) return -1;
+        }
+        else
+        {
+            if (sent < size) ns = (long)xferPush(e, s + sent, size - sent);
+
+            if (recvd < size) nr = (long)xferPop(e, r + recvd, size - recvd);
+        }
+
+        sent += ns;
+        recvd += nr;
+
+        // after a hangup, one more round for what was already in the ring
+        if (ns + nr > 0)
+            idle = 0;
+        else if (gone)
+            return -1;
+        else
+            gone = xferWait(e, &idle, sent < size, recvd < size);
+    }
+
+    return 0;
+}
+
+static inline void xferClose(XferEnd *e)
+{
+    close(e->fd);
+
+    if (__atomic_sub_fetch(e->open, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (e->kind == XFER_SHM)
+            munmap(e->map, e->mapLen);
+        else
+            free(e->map);
+
+        free(e->open);
+    }
+
+    e->map = NULL;
+    e->open = NULL;
+    e->fd = -1;
+}
+
+// both ends of a transport, for xferPair to be called before any fork
+static inline int xferPair(const XferKind kind, XferEnd *a, XferEnd *b)
+{
+    const long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t len = 2 * sizeof(XferRing);
+    void *map = NULL;
+
+    memset(a, 0, sizeof(XferEnd));
+    memset(b, 0, sizeof(XferEnd));
+    a->kind = b->kind = kind;
+    a->spin = b->spin = nproc > 1 ? XFER_SPIN : 0;
+    a->fd = b->fd = -1;
+
+    int fd[2];
+    int *open = (int *)malloc(sizeof(int));
+
+    if (open == NULL) return -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0)
+    {
+        free(open);
+        return -1;
+    }
+
+    *open = 2;
+    a->open = b->open = open;
+    a->fd = fd[0];
+    b->fd = fd[1];
+
+    if (kind == XFER_SOCKET) return 0;
+
+    if (kind == XFER_SHM)
+    {
+        char name[64];
+
+        snprintf(name, sizeof(name), "/xfer-%ld-%p", (long)getpid(),
+                 (void *)a);
+
+        int shm = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+        if (shm >= 0)
+        {
+            shm_unlink(name);
+
+            if (ftruncate(shm, (off_t)len) != 0 ||
+                    (map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                shm, 0)) == MAP_FAILED)
+                map = NULL;
+
+            close(shm);
+        }
+    }
+    else if (posix_memalign(&map, XFER_LINE, len) != 0)
+    {
+        map = NULL;
+    }
+
+    if (map == NULL)
+    {
+        close(fd[0]);
+        close(fd[1]);
+        free(open);
+        return -1;
+    }
+
+    XferRing *ring = (XferRing *)map;
+
+    ring[0].head = ring[0].tail = 0;
+    ring[1].head = ring[1].tail = 0;
+    a->tx = b->rx = ring;
+    a->rx = b->tx = ring + 1;
+    a->map = b->map = map;
+    a->mapLen = b->mapLen = len;
+
+    return 0;
+}
+
+#endif // _TRANSPORT_H
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef _TRANSPOSE_H
+#define _TRANSPOSE_H
+
+/*
+ * Host matrix transposes. in holds ny rows of nx floats and out receives nx
+ * rows of ny floats, out[ix * ny + iy] = in[iy * nx + ix], the same layout as
+ * transposeHost and the transpose kernels in transpose.cu.
+ *
+ * The naive double loop writes out with a stride of ny floats, so for a
+ * 4096 x 4096 matrix every store lands on a different page and the TLB and
+ * the caches thrash. The versions here keep both sides local:
+ *
+ *   transposeRecursive   cache-oblivious: split the longer side in half
+ *                        until the block fits in L1, whatever the cache sizes
+ *   transposeTiled       TRANSPOSE_BLOCK square blocks (a few pages each way)
+ *                        made of 8 x 8 tiles transposed in AVX registers
+ *                        (4 x 4 in SSE registers without AVX)
+ *   transposeInPlace     square matrix, tiles swapped across the diagonal
+ *   transposeParallel, transposeInPlaceParallel
+ *                        the same split over POSIX threads
+ */
+
+// block edge for the tiled versions, in floats
+#ifndef TRANSPOSE_BLOCK
+#define TRANSPOSE_BLOCK     64
+#endif
+
+// leaves of the recursion hold at most this many elements
+#define TRANSPOSE_LEAF      (32 * 32)
+
+#if defined(__AVX__)
+#define TRANSPOSE_TILE      8
+#elif defined(__SSE2__)
+#define TRANSPOSE_TILE      4
+#else
+#define TRANSPOSE_TILE      1
+#endif
+
+// the reference double loop
+static inline void transposeNaive(float *out, const float *in, const int nx,
+                                  const int ny)
+{
+    for (int iy = 0; iy < ny; ++iy)
+    {
+        for (int ix = 0; ix < nx; ++ix)
+        {
+            out[(size_t)ix * ny + iy] = in[(size_t)iy * nx + ix];
+        }
+    }
+}
+
+/*
+ * Transpose one TRANSPOSE_TILE square tile: rows of in are ldi apart, rows
+ * of out ldo apart.
+ */
+static inline void transposeTile(float *out, size_t ldo, const float *in,
+                                 size_t ldi)
+{
+#if defined(__AVX__)
+    __m256 r0 = _mm256_loadu_ps(in);
+    __m256 r1 = _mm256_loadu_ps(in + ldi);
+    __m256 r2 = _mm256_loadu_ps(in + 2 * ldi);
+    __m256 r3 = _mm256_loadu_ps(in + 3 * ldi);
+    __m256 r4 = _mm256_loadu_ps(in + 4 * ldi);
+    __m256 r5 = _mm256_loadu_ps(in + 5 * ldi);
+    __m256 r6 = _mm256_loadu_ps(in + 6 * ldi);
+    __m256 r7 = _mm256_loadu_ps(in + 7 * ldi);
+
+    // interleave pairs of rows
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+    // gather 4 x 4 blocks within each 128-bit lane
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    // swap the off-diagonal lanes
+    _mm256_storeu_ps(out,           _mm256_permute2f128_ps(s0, s4, 0x20));
+    _mm256_storeu_ps(out + ldo,     _mm256_permute2f128_ps(s1, s5, 0x20));
+    _mm256_storeu_ps(out + 2 * ldo, _mm256_permute2f128_ps(s2, s6, 0x20));
+    _mm256_storeu_ps(out + 3 * ldo, _mm256_permute2f128_ps(s3, s7, 0x20));
+    _mm256_storeu_ps(out + 4 * ldo, _mm256_permute2f128_ps(s0, s4, 0x31));
+    _mm256_storeu_ps(out + 5 * ldo, _mm256_permute2f128_ps(s1, s5, 0x31));
+    _mm256_storeu_ps(out + 6 * ldo, _mm256_permute2f128_ps(s2, s6, 0x31));
+    _mm256_storeu_ps(out + 7 * ldo, _mm256_permute2f128_ps(s3, s7, 0x31));
+#elif defined(__SSE2__)
+    __m128 r0 = _mm_loadu_ps(in);
+    __m128 r1 = _mm_loadu_ps(in + ldi);
+    __m128 r2 = _mm_loadu_ps(in + 2 * ldi);
+    __m128 r3 = _mm_loadu_ps(in + 3 * ldi);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(out,           r0);
+    _mm_storeu_ps(out + ldo,     r1);
+    _mm_storeu_ps(out + 2 * ldo, r2);
+    _mm_storeu_ps(out + 3 * ldo, r3);
+#else
+    (void)ldo;
+    (void)ldi;
+    out[0] = in[0];
+#endif
+}
+
+/*
+ * Transpose a rows x cols block of in into out: whole tiles in registers,
+ * the ragged right and bottom edges element by element.
+ */
+static inline void transposeBlock(float *out, size_t ldo, const float *in,
+                                  size_t ldi, int rows, int cols)
+{
+    const int T = TRANSPOSE_TILE;
+    int rt = rows - rows % T;
+    int ct = cols - cols % T;
+
+    // walk along rows of out, so its lines are filled one after another
+    for (int j = 0; j < ct; j += T)
+    {
+        for (int i = 0; i < rt; i += T)
+        {
+            transposeTile(out + j * ldo + i, ldo, in + i * ldi + j, ldi);
+        }
+    }
+
+    for (int j = 0; j < cols; j++)
+    {
+        int i0 = j < ct ? rt : 0;
+
+        for (int i = i0; i < rows; i++)
+        {
+            out[j * ldo + i] = in[i * ldi + j];
+        }
+    }
+}
+
+static inline void transposeRecurse(float *out, size_t ldo, const float *in,
+                                    size_t ldi, int rows, int cols)
+{
+    if ((size_t)rows * cols <= TRANSPOSE_LEAF || rows < 2 * TRANSPOSE_TILE ||
+        cols < 2 * TRANSPOSE_TILE)
+    {
+        transposeBlock(out, ldo, in, ldi, rows, cols);
+    }
+    else if (rows >= cols)
+    {
+        // split rows on a tile boundary so the leaves stay in registers
+        int half = (rows / 2) / TRANSPOSE_TILE * TRANSPOSE_TILE;
+        transposeRecurse(out, ldo, in, ldi, half, cols);
+        transposeRecurse(out + half, ldo, in + half * ldi, ldi, rows - half,
+                         cols);
+    }
+    else
+    {
+        int half = (cols / 2) / TRANSPOSE_TILE * TRANSPOSE_TILE;
+        transposeRecurse(out, ldo, in, ldi, rows, half);
+        transposeRecurse(out + half * ldo, ldo, in + half, ldi, rows,
+                         cols - half);
+    }
+}
+
+static inline void transposeRecursive(float *out, const float *in,
+                                      const int nx, const int ny)
+{
+    transposeRecurse(out, ny, in, nx, ny, nx);
+}
+
+// in rows [y0, y1) of in, i.e. out columns [y0, y1)
+static inline void transposeRows(float *out, const float *in, const int nx,
+                                 const int ny, int y0, int y1)
+{
+    const int B = TRANSPOSE_BLOCK;
+
+    for (int iy = y0; iy < y1; iy += B)
+    {
+        int rows = y1 - iy < B ? y1 - iy : B;
+
+        for (int ix = 0; ix < nx; ix += B)
+        {
+            int cols = nx - ix < B ? nx - ix : B;
+            transposeBlock(out + (size_t)ix * ny + iy, ny,
+                           in + (size_t)iy * nx + ix, nx, rows, cols);
+        }
+    }
+}
+
+static inline void transposeTiled(float *out, const float *in, const int nx,
+                                  const int ny)
+{
+    transposeRows(out, in, nx, ny, 0, ny);
+}
+
+/*
+ * Swap tile (i, j) with tile (j, i) of the n x n matrix a, both transposed;
+ * on the diagonal the tile is transposed in place.
+ */
+static inline void transposeSwapTiles(float *a, size_t n, int i, int j)
+{
+    const int T = TRANSPOSE_TILE;
+    float *p = a + i * n + j;
+    float *q = a + j * n + i;
+
+#if TRANSPOSE_TILE > 1
+    float tp[TRANSPOSE_TILE * TRANSPOSE_TILE];
+    float tq[TRANSPOSE_TILE * TRANSPOSE_TILE];
+
+    transposeTile(tp, T, p, n);
+
+    if (i != j)
+    {
+        transposeTile(tq, T, q, n);
+
+        for (int r = 0; r < T; r++)
+            memcpy(p + r * n, tq + r * T, T * sizeof(float));
+    }
+
+    for (int r = 0; r < T; r++)
+        memcpy(q + r * n, tp + r * T, T * sizeof(float));
+#else
+    float t = *p;
+    *p = *q;
+    *q = t;
+#endif
+}
+
+// block row bi of the upper triangle, plus the ragged edge in that row
+static inline void transposeInPlaceRow(float *a, const int n, int bi)
+{
+    const int B = TRANSPOSE_BLOCK;
+    const int T = TRANSPOSE_TILE;
+    int nt = n - n % T;
+    int i0 = bi * B;
+    int i1 = i0 + B < nt ? i0 + B : nt;
+
+    for (int bj = i0; bj < nt; bj += B)
+    {
+        int j1 = bj + B < nt ? bj + B : nt;
+
+        for (int i = i0; i < i1; i += T)
+        {
+            for (int j = (bj == i0 ? i : bj); j < j1; j += T)
+            {
+                transposeSwapTiles(a, n, i, j);
+            }
+        }
+    }
+
+    // columns past the last whole tile
+    for (int i = i0; i < i1; i++)
+    {
+        for (int j = nt; j < n; j++)
+        {
+            float t = a[(size_t)i * n + j];
+            a[(size_t)i * n + j] = a[(size_t)j * n + i];
+            a[(size_t)j * n + i] = t;
+        }
+    }
+
+    // the bottom right corner goes with the last block row
+    if (i1 == nt)
+    {
+        for (int i = nt; i < n; i++)
+        {
+            for (int j = i + 1; j < n; j++)
+            {
+                float t = a[(size_t)i * n + j];
+                a[(size_t)i * n + j] = a[(size_t)j * n + i];
+                a[(size_t)j * n + i] = t;
+            }
+        }
+    }
+}
+
+static inline int transposeBlockRows(const int n)
+{
+    int nt = n - n % TRANSPOSE_TILE;
+    int nb = (nt + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+    return nb > 0 ? nb : 1;
+}
+
+// transpose the n x n matrix a in place
+static inline void transposeInPlace(float *a, const int n)
+{
+    for (int bi = 0; bi < transposeBlockRows(n); bi++)
+    {
+        transposeInPlaceRow(a, n, bi);
+    }
+}
+
+typedef struct
+{
+    float *out;
+    const float *in;
+    int nx, ny;
+    int id, nthreads;
+} TransposeJob;
+
+static inline void *transposeWorker(void *arg)
+{
+    TransposeJob *job = (TransposeJob *)arg;
+    int nb = (job->ny + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+
+    // whole blocks of rows, so no two threads write the same cache line
+    int y0 = (int)((long)nb * job->id / job->nthreads) * TRANSPOSE_BLOCK;
+    int y1 = (int)((long)nb * (job->id + 1) / job->nthreads) * TRANSPOSE_BLOCK;
+
+    if (y1 > job->ny) y1 = job->ny;
+
+    if (job->in != NULL)
+    {
+        transposeRows(job->out, job->in, job->nx, job->ny, y0, y1);
+    }
+    else
+    {
+        // in place: the upper triangle shrinks down the matrix, so deal
+        // block rows round robin to keep the work even
+        for (int bi = job->id; bi < transposeBlockRows(job->nx);
+             bi += job->nthreads)
+        {
+            transposeInPlaceRow(job->out, job->nx, bi);
+        }
+    }
+
+    return NULL;
+}
+
+static inline void transposeLaunch(float *out, const float *in, const int nx,
+                                   const int ny, int nthreads)
+{
+    if (nthreads < 1) nthreads = 1;
+
+    pthread_t *tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    TransposeJob *job = (TransposeJob *)malloc(nthreads *
+                        sizeof(TransposeJob));
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        job[i].out      = out;
+        job[i].in       = in;
+        job[i].nx       = nx;
+        job[i].ny       = ny;
+        job[i].id       = i;
+        job[i].nthreads = nthreads;
+
+        if (i > 0) pthread_create(&tid[i], NULL, transposeWorker, &job[i]);
+    }
+
+    transposeWorker(&job[0]);
+
+    for (int i = 1; i < nthreads; i++) pthread_join(tid[i], NULL);
+
+    free(tid);
+    free(job);
+}
+
+static inline void transposeParallel(float *out, const float *in,
+                                     const int nx, const int ny,
+                                     int nthreads)
+{
+    transposeLaunch(out, in, nx, ny, nthreads);
+}
+
+static inline void transposeInPlaceParallel(float *a, const int n,
+                                            int nthreads)
+{
+    transposeLaunch(a, NULL, n, n, nthreads);
+}
+
+#endif // _TRANSPOSE_H